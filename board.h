@@ -0,0 +1,129 @@
+/*
+ * board.h - the rules and symmetries of a board, for the generators.
+ *
+ * tbgen.c and bookgen.c solve and search boards in userspace. They share the
+ * segments, the win check and the symmetries of game.c from here, for any
+ * board size, goal and ALLOW_EXCEED, so that their output follows the rules
+ * of the module.
+ */
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define BOARD_MAX_GRIDS 32
+#define BOARD_MAX_SEGS 128
+
+static int board_size, board_goal, board_allow_exceed, n_grids;
+static uint32_t full_board;
+
+/* Segments of board_goal grids in the four directions of check_win(), and
+ * the grids just past both of their ends, which spoil a run of the same
+ * player unless board_allow_exceed. n_segs[i] counts the segments through
+ * grid i.
+ */
+static uint32_t win_masks[BOARD_MAX_SEGS], win_borders[BOARD_MAX_SEGS];
+static int n_win_masks, n_segs[BOARD_MAX_GRIDS];
+
+/* sym_grids[t][i] is where grid i lands under the rotation or reflection t */
+static int sym_grids[8][BOARD_MAX_GRIDS];
+
+static uint32_t board_bit(int i, int j)
+{
+    if (i < 0 || i >= board_size || j < 0 || j >= board_size)
+        return 0;
+    return 1U << (i * board_size + j);
+}
+
+static void board_init(int size, int goal, int allow_exceed)
+{
+    static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+    board_size = size;
+    board_goal = goal;
+    board_allow_exceed = allow_exceed;
+    n_grids = size * size;
+    full_board = n_grids == 32 ? ~0U : (1U << n_grids) - 1;
+    n_win_masks = 0;
+    memset(n_segs, 0, sizeof(n_segs));
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            for (int d = 0; d < 4; d++) {
+                int di = dirs[d][0], dj = dirs[d][1];
+                if (!board_bit(i + (goal - 1) * di, j + (goal - 1) * dj))
+                    continue;
+                uint32_t mask = 0;
+                for (int k = 0; k < goal; k++) {
+                    mask |= board_bit(i + k * di, j + k * dj);
+                    n_segs[(i + k * di) * size + j + k * dj]++;
+                }
+                win_borders[n_win_masks] = board_bit(i - di, j - dj) |
+                                           board_bit(i + goal * di,
+                                                     j + goal * dj);
+                win_masks[n_win_masks++] = mask;
+            }
+            for (int t = 0; t < 8; t++) {
+                int x = i, y = j;
+                if (t & 4) {
+                    int tmp = x;
+                    x = y;
+                    y = tmp;
+                }
+                if (t & 1)
+                    x = size - 1 - x;
+                if (t & 2)
+                    y = size - 1 - y;
+                sym_grids[t][i * size + j] = x * size + y;
+            }
+        }
+    }
+}
+
+/* Do the stones of a player, @stones, win through the grid @move? */
+static int board_wins(uint32_t stones, int move)
+{
+    for (int s = 0; s < n_win_masks; s++) {
+        if (!(win_masks[s] & (1U << move)) ||
+            (stones & win_masks[s]) != win_masks[s])
+            continue;
+        if (board_allow_exceed || !(stones & win_borders[s]))
+            return 1;
+    }
+    return 0;
+}
+
+static uint32_t board_transform(uint32_t stones, int t)
+{
+    uint32_t out = 0;
+
+    for (int i = 0; i < n_grids; i++)
+        if (stones & (1U << i))
+            out |= 1U << sym_grids[t][i];
+    return out;
+}
+
+/* Canonical form of the position @board, as bitboard_canonical() in game.h:
+ * the symmetric form with the smallest 'X' stones, then 'O' stones. Return
+ * the symmetry that gives it.
+ */
+static int board_canonical(const uint32_t board[2], uint32_t canon[2])
+{
+    int sym = 0;
+
+    canon[0] = board[0];
+    canon[1] = board[1];
+    for (int t = 1; t < 8; t++) {
+        uint32_t o = board_transform(board[0], t);
+        uint32_t x = board_transform(board[1], t);
+        if (x < canon[1] || (x == canon[1] && o < canon[0])) {
+            canon[0] = o;
+            canon[1] = x;
+            sym = t;
+        }
+    }
+    return sym;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include <linux/bsearch.h>
+#include <linux/build_bug.h>
+#include <linux/kernel.h>
+
+#include "book.h"
+#include "game.h"
+
+#include BOOK_FILE
+
+/* A book searched under other rules would play the moves of another game */
+static_assert(BOOK_BOARD_SIZE == BOARD_SIZE && BOOK_GOAL == GOAL &&
+                  BOOK_ALLOW_EXCEED == ALLOW_EXCEED,
+              BOOK_FILE " was generated for other rules, run make book");
+
+static int cmp_book(const void *key, const void *elt)
+{
+    u64 a = *(const u64 *) key, b = ((const struct book_entry *) elt)->key;
+
+    return a < b ? -1 : a > b;
+}
+
+/* The book move of @player in @table, or -1 if the position is not in the
+ * book. Like the tablebase, the book is keyed by the canonical form of the
+ * position, whose move is mapped back onto @table.
+ */
+int book_move(const char *table, char player)
+{
+    const struct book_entry *entry;
+    bitboard_t board[2], canon[2];
+    u64 key;
+    int sym, move;
+
+    bitboard_from_table(table, board);
+    if (!bitboard_is_turn(board, player))
+        return -1;
+    sym = bitboard_canonical(board, canon);
+    key = BOOK_KEY(canon[0], canon[1]);
+    entry = bsearch(&key, book, ARRAY_SIZE(book), sizeof(*entry), cmp_book);
+    if (!entry || entry->move >= N_GRIDS)
+        return -1;
+    move = sym_grids_inv[sym][entry->move];
+    return table[move] == ' ' ? move : -1;
+}
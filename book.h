@@ -0,0 +1,30 @@
+/*
+ * book.h - the opening books of the variants.
+ *
+ * bookgen.c searches the first plies of every variant offline and writes
+ * book_<variant>.h, a sorted array of struct book_entry that each variant
+ * compiles in and looks moves up from by binary search. The file also
+ * defines BOOK_BOARD_SIZE, BOOK_GOAL and BOOK_ALLOW_EXCEED, the rules it was
+ * searched under, which have to match those of the variant.
+ */
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <linux/types.h>
+
+/* A position is keyed by its 'X' bitboard above its 'O' bitboard, in the
+ * canonical form of game.h, and its move is given in that frame.
+ */
+#define BOOK_KEY(o, x) ((__u64) (x) << 32 | (__u32) (o))
+
+struct book_entry {
+    __u64 key;
+    __u8 move;
+};
+
+#ifdef __KERNEL__
+int book_move(const char *table, char player);
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+/* Generated by bookgen.c, do not edit.
+ *
+ * Opening book of the 3x3 board: the move of a depth 9 search for
+ * each of the 16 canonical positions of the first 3 plies.
+ */
+
+/* The rules the book was searched under */
+#define BOOK_BOARD_SIZE 3
+#define BOOK_GOAL 3
+#define BOOK_ALLOW_EXCEED 1
+
+static const struct book_entry book[] = {
+    {0x0000000000000000ULL, 4},
+    {0x0000000000000001ULL, 4},
+    {0x0000000000000002ULL, 4},
+    {0x0000000000000010ULL, 0},
+    {0x0000000100000002ULL, 4},
+    {0x0000000100000004ULL, 8},
+    {0x0000000100000010ULL, 1},
+    {0x0000000100000020ULL, 2},
+    {0x0000000100000100ULL, 2},
+    {0x0000000200000001ULL, 6},
+    {0x0000000200000008ULL, 0},
+    {0x0000000200000010ULL, 0},
+    {0x0000000200000040ULL, 0},
+    {0x0000000200000080ULL, 4},
+    {0x0000001000000001ULL, 2},
+    {0x0000001000000002ULL, 6},
+};
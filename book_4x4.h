@@ -0,0 +1,50 @@
+/* Generated by bookgen.c, do not edit.
+ *
+ * Opening book of the 4x4 board: the move of a depth 16 search for
+ * each of the 37 canonical positions of the first 3 plies.
+ */
+
+/* The rules the book was searched under */
+#define BOOK_BOARD_SIZE 4
+#define BOOK_GOAL 3
+#define BOOK_ALLOW_EXCEED 1
+
+static const struct book_entry book[] = {
+    {0x0000000000000000ULL, 5},
+    {0x0000000000000001ULL, 5},
+    {0x0000000000000002ULL, 3},
+    {0x0000000000000020ULL, 6},
+    {0x0000000100000002ULL, 3},
+    {0x0000000100000004ULL, 1},
+    {0x0000000100000008ULL, 1},
+    {0x0000000100000020ULL, 6},
+    {0x0000000100000040ULL, 5},
+    {0x0000000100000080ULL, 11},
+    {0x0000000100000400ULL, 6},
+    {0x0000000100000800ULL, 7},
+    {0x0000000100008000ULL, 7},
+    {0x0000000200000001ULL, 8},
+    {0x0000000200000004ULL, 5},
+    {0x0000000200000008ULL, 6},
+    {0x0000000200000010ULL, 8},
+    {0x0000000200000020ULL, 6},
+    {0x0000000200000040ULL, 5},
+    {0x0000000200000080ULL, 11},
+    {0x0000000200000100ULL, 4},
+    {0x0000000200000200ULL, 6},
+    {0x0000000200000400ULL, 5},
+    {0x0000000200000800ULL, 7},
+    {0x0000000200001000ULL, 6},
+    {0x0000000200002000ULL, 14},
+    {0x0000000200004000ULL, 13},
+    {0x0000000200008000ULL, 5},
+    {0x0000002000000001ULL, 4},
+    {0x0000002000000002ULL, 2},
+    {0x0000002000000004ULL, 1},
+    {0x0000002000000008ULL, 11},
+    {0x0000002000000040ULL, 9},
+    {0x0000002000000080ULL, 11},
+    {0x0000002000000400ULL, 6},
+    {0x0000002000000800ULL, 7},
+    {0x0000002000008000ULL, 7},
+};
@@ -0,0 +1,105 @@
+/* Generated by bookgen.c, do not edit.
+ *
+ * Opening book of the 5x5 board: the move of a depth 9 search for
+ * each of the 92 canonical positions of the first 3 plies.
+ */
+
+/* The rules the book was searched under */
+#define BOOK_BOARD_SIZE 5
+#define BOOK_GOAL 4
+#define BOOK_ALLOW_EXCEED 1
+
+static const struct book_entry book[] = {
+    {0x0000000000000000ULL, 6},
+    {0x0000000000000001ULL, 18},
+    {0x0000000000000002ULL, 12},
+    {0x0000000000000004ULL, 12},
+    {0x0000000000000040ULL, 12},
+    {0x0000000000000080ULL, 12},
+    {0x0000000000001000ULL, 6},
+    {0x0000000100000002ULL, 12},
+    {0x0000000100000004ULL, 6},
+    {0x0000000100000008ULL, 12},
+    {0x0000000100000010ULL, 13},
+    {0x0000000100000040ULL, 12},
+    {0x0000000100000080ULL, 8},
+    {0x0000000100000100ULL, 12},
+    {0x0000000100000200ULL, 13},
+    {0x0000000100001000ULL, 8},
+    {0x0000000100002000ULL, 8},
+    {0x0000000100004000ULL, 12},
+    {0x0000000100040000ULL, 8},
+    {0x0000000100080000ULL, 17},
+    {0x0000000101000000ULL, 12},
+    {0x0000000200000001ULL, 5},
+    {0x0000000200000004ULL, 6},
+    {0x0000000200000008ULL, 12},
+    {0x0000000200000010ULL, 12},
+    {0x0000000200000020ULL, 15},
+    {0x0000000200000040ULL, 7},
+    {0x0000000200000080ULL, 6},
+    {0x0000000200000100ULL, 6},
+    {0x0000000200000200ULL, 19},
+    {0x0000000200000400ULL, 12},
+    {0x0000000200000800ULL, 12},
+    {0x0000000200001000ULL, 8},
+    {0x0000000200002000ULL, 12},
+    {0x0000000200004000ULL, 12},
+    {0x0000000200008000ULL, 12},
+    {0x0000000200010000ULL, 18},
+    {0x0000000200020000ULL, 16},
+    {0x0000000200040000ULL, 16},
+    {0x0000000200080000ULL, 12},
+    {0x0000000200100000ULL, 11},
+    {0x0000000200200000ULL, 23},
+    {0x0000000200400000ULL, 21},
+    {0x0000000200800000ULL, 21},
+    {0x0000000201000000ULL, 12},
+    {0x0000000400000001ULL, 11},
+    {0x0000000400000002ULL, 8},
+    {0x0000000400000020ULL, 12},
+    {0x0000000400000040ULL, 8},
+    {0x0000000400000080ULL, 12},
+    {0x0000000400000400ULL, 12},
+    {0x0000000400000800ULL, 12},
+    {0x0000000400001000ULL, 11},
+    {0x0000000400008000ULL, 12},
+    {0x0000000400010000ULL, 18},
+    {0x0000000400020000ULL, 12},
+    {0x0000000400100000ULL, 17},
+    {0x0000000400200000ULL, 23},
+    {0x0000000400400000ULL, 12},
+    {0x0000004000000001ULL, 12},
+    {0x0000004000000002ULL, 3},
+    {0x0000004000000004ULL, 8},
+    {0x0000004000000008ULL, 1},
+    {0x0000004000000010ULL, 18},
+    {0x0000004000000080ULL, 11},
+    {0x0000004000000100ULL, 13},
+    {0x0000004000000200ULL, 19},
+    {0x0000004000001000ULL, 7},
+    {0x0000004000002000ULL, 8},
+    {0x0000004000004000ULL, 19},
+    {0x0000004000040000ULL, 8},
+    {0x0000004000080000ULL, 9},
+    {0x0000004001000000ULL, 12},
+    {0x0000008000000001ULL, 11},
+    {0x0000008000000002ULL, 12},
+    {0x0000008000000004ULL, 12},
+    {0x0000008000000020ULL, 16},
+    {0x0000008000000040ULL, 12},
+    {0x0000008000000400ULL, 5},
+    {0x0000008000000800ULL, 6},
+    {0x0000008000001000ULL, 16},
+    {0x0000008000008000ULL, 5},
+    {0x0000008000010000ULL, 12},
+    {0x0000008000020000ULL, 11},
+    {0x0000008000100000ULL, 13},
+    {0x0000008000200000ULL, 23},
+    {0x0000008000400000ULL, 17},
+    {0x0000100000000001ULL, 6},
+    {0x0000100000000002ULL, 3},
+    {0x0000100000000004ULL, 6},
+    {0x0000100000000040ULL, 13},
+    {0x0000100000000080ULL, 11},
+};
@@ -0,0 +1,254 @@
+/*  bookgen.c - search the openings of every variant and write their books
+ *
+ *  For each variant, every position of the first BOOK_PLIES plies is searched
+ *  with a deep alpha-beta negamax, up to the symmetries of the board, and the
+ *  best moves are written to book_<variant>.h in the format of book.h. The
+ *  module compiles the books in, so rerun this after changing the rules or
+ *  the search:
+ *
+ *      make book
+ */
+
+#include "board.h"
+#include "book.h"
+
+#include <stdint.h>
+#include <stdio.h>  /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <string.h>
+
+/* Plies of a game that the books cover */
+#define BOOK_PLIES 3
+
+/* The rules of variant_*.c, which book.c checks against those of the module
+ * it is compiled into. depth is that of the search, which solves the smaller
+ * boards.
+ */
+static const struct variant {
+    const char *name;
+    int board_size, goal, allow_exceed, depth;
+} variants[] = {
+    {"3x3", 3, 3, 1, 9},
+    {"4x4", 4, 3, 1, 16},
+    {"5x5", 5, 4, 1, 9},
+};
+
+#define MAX_GRIDS BOARD_MAX_GRIDS
+
+/* The grids of the board, most segments through them first, as the move
+ * order
+ */
+static int grid_order[MAX_GRIDS];
+
+static void init_board(const struct variant *v)
+{
+    board_init(v->board_size, v->goal, v->allow_exceed);
+    for (int i = 0; i < n_grids; i++) {
+        int j = i;
+        for (; j > 0 && n_segs[grid_order[j - 1]] < n_segs[i]; j--)
+            grid_order[j] = grid_order[j - 1];
+        grid_order[j] = i;
+    }
+}
+
+/* The pattern score of game.c, for the player owning @me */
+static int eval(uint32_t me, uint32_t opp)
+{
+    static const int powers[] = {0, 1, 10, 100, 1000, 10000};
+    int score = 0;
+
+    for (int s = 0; s < n_win_masks; s++) {
+        int m = __builtin_popcount(me & win_masks[s]);
+        int o = __builtin_popcount(opp & win_masks[s]);
+        if (!o)
+            score += powers[m];
+        else if (!m)
+            score -= powers[o];
+    }
+    return score;
+}
+
+/* A won position scores WIN less the plies to the win, so that the search
+ * prefers fast wins and slow losses. Scores are relative to the node and
+ * can be stored as they are.
+ */
+#define WIN 1000000
+#define WIN_MIN (WIN - MAX_GRIDS)
+
+enum { BOUND_EXACT = 1, BOUND_LOWER, BOUND_UPPER };
+
+struct tt_entry {
+    uint64_t key;
+    int32_t score;
+    int8_t move;
+    uint8_t depth, bound;
+};
+
+#define TT_BITS 22
+static struct tt_entry *tt;
+
+static struct tt_entry *tt_slot(uint32_t me, uint32_t opp)
+{
+    uint64_t key = (uint64_t) opp << 32 | me;
+    return &tt[(key * 0x9e3779b97f4a7c15ULL) >> (64 - TT_BITS)];
+}
+
+/* Negamax with alpha-beta and a transposition table for the player owning
+ * @me, who is to move in a position that is not over yet.
+ */
+static int search(uint32_t me, uint32_t opp, int depth, int alpha, int beta,
+                  int *best_move)
+{
+    uint64_t key = (uint64_t) opp << 32 | me;
+    struct tt_entry *entry = tt_slot(me, opp);
+    int tt_move = -1;
+
+    if (!depth)
+        return eval(me, opp);
+    if (entry->key == key && entry->bound) {
+        tt_move = entry->move;
+        if (entry->depth >= depth &&
+            (entry->bound == BOUND_EXACT ||
+             (entry->bound == BOUND_LOWER && entry->score >= beta) ||
+             (entry->bound == BOUND_UPPER && entry->score <= alpha))) {
+            *best_move = tt_move;
+            return entry->score;
+        }
+    }
+
+    int moves[MAX_GRIDS], n_moves = 0;
+    if (tt_move >= 0)
+        moves[n_moves++] = tt_move;
+    for (int i = 0; i < n_grids; i++) {
+        int m = grid_order[i];
+        if (!((me | opp) & (1U << m)) && m != tt_move)
+            moves[n_moves++] = m;
+    }
+
+    int alpha_orig = alpha, best = -WIN - 1, unused;
+    *best_move = -1;
+    for (int i = 0; i < n_moves && alpha < beta; i++) {
+        uint32_t next = me | (1U << moves[i]);
+        int score;
+        if (board_wins(next, moves[i]))
+            score = WIN;
+        else if ((next | opp) == full_board)
+            score = 0;
+        else /* one wider, as the score moves by one on the way up */
+            score = -search(opp, next, depth - 1, -beta - 1, -alpha + 1,
+                            &unused);
+        if (score > WIN_MIN)
+            score--;
+        else if (score < -WIN_MIN)
+            score++;
+        if (score > best) {
+            best = score;
+            *best_move = moves[i];
+        }
+        if (score > alpha)
+            alpha = score;
+    }
+
+    entry->key = key;
+    entry->score = best;
+    entry->move = *best_move;
+    entry->depth = depth;
+    entry->bound = best <= alpha_orig ? BOUND_UPPER
+                   : best >= beta     ? BOUND_LOWER
+                                      : BOUND_EXACT;
+    return best;
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+    uint64_t ka = ((const struct book_entry *) a)->key;
+    uint64_t kb = ((const struct book_entry *) b)->key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+static void write_book(const struct variant *v)
+{
+    static struct book_entry book[1 << 16];
+    static uint32_t positions[2][1 << 16][2];
+    int n_book = 0, n = 1;
+    char path[32];
+
+    init_board(v);
+    memset(tt, 0, sizeof(*tt) << TT_BITS);
+
+    /* Walk the canonical positions ply by ply from the empty board */
+    positions[0][0][0] = positions[0][0][1] = 0;
+    for (int ply = 0; ply < BOOK_PLIES; ply++) {
+        uint32_t(*cur)[2] = positions[ply & 1];
+        uint32_t(*next)[2] = positions[~ply & 1];
+        int n_next = 0;
+        for (int k = 0; k < n; k++) {
+            uint32_t o = cur[k][0], x = cur[k][1];
+            uint32_t me = ply & 1 ? x : o, opp = ply & 1 ? o : x;
+            int move = -1;
+            for (int depth = 1; depth <= v->depth; depth++)
+                search(me, opp, depth, -WIN - 1, WIN + 1, &move);
+            book[n_book].key = BOOK_KEY(o, x);
+            book[n_book++].move = move;
+
+            for (int m = 0; m < n_grids; m++) {
+                uint32_t board[2] = {o, x}, canon[2];
+                if ((o | x) & (1U << m))
+                    continue;
+                board[ply & 1] |= 1U << m;
+                board_canonical(board, canon);
+                int seen = 0;
+                for (int j = 0; j < n_next && !seen; j++)
+                    seen = next[j][0] == canon[0] && next[j][1] == canon[1];
+                if (!seen) {
+                    next[n_next][0] = canon[0];
+                    next[n_next++][1] = canon[1];
+                }
+            }
+        }
+        n = n_next;
+    }
+    qsort(book, n_book, sizeof(*book), cmp_entries);
+
+    snprintf(path, sizeof(path), "book_%s.h", v->name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f,
+            "/* Generated by bookgen.c, do not edit.\n"
+            " *\n"
+            " * Opening book of the %s board: the move of a depth %d search "
+            "for\n"
+            " * each of the %d canonical positions of the first %d plies.\n"
+            " */\n\n"
+            "/* The rules the book was searched under */\n"
+            "#define BOOK_BOARD_SIZE %d\n"
+            "#define BOOK_GOAL %d\n"
+            "#define BOOK_ALLOW_EXCEED %d\n\n"
+            "static const struct book_entry book[] = {\n",
+            v->name, v->depth, n_book, BOOK_PLIES, v->board_size, v->goal,
+            v->allow_exceed);
+    for (int i = 0; i < n_book; i++)
+        fprintf(f, "    {0x%016llxULL, %d},\n",
+                (unsigned long long) book[i].key, book[i].move);
+    fprintf(f, "};\n");
+    if (fclose(f)) {
+        perror(path);
+        exit(1);
+    }
+    printf("%s: %d positions\n", path, n_book);
+}
+
+int main(void)
+{
+    tt = malloc(sizeof(*tt) << TT_BITS);
+    if (!tt) {
+        perror("malloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++)
+        write_book(&variants[i]);
+    return 0;
+}
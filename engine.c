@@ -0,0 +1,76 @@
+/* One copy of the game engines, specialized by the BOARD_SIZE, GOAL,
+ * ALLOW_EXCEED, VARIANT and BOOK_FILE definitions of the including
+ * variant_*.c.
+ */
+
+#include "param.h"
+
+#include "book.c"
+#include "game.c"
+#include "mcts.c"
+#include "negamax.c"
+#include "tablebase.c"
+#include "zobrist.c"
+
+/* The negamax player of the variant, which plays one game at a time */
+static struct zobrist_tt negamax_tt;
+static struct search_ctx negamax_ctx;
+
+static int variant_init(struct workqueue_struct *wq, struct device *dev)
+{
+    int ret;
+
+    game_init();
+    negamax_init(wq);
+    ret = zobrist_tt_init(&negamax_tt, READ_ONCE(negamax_tt_mb));
+    if (ret)
+        return ret;
+    search_ctx_init(&negamax_ctx, &negamax_tt);
+    ret = mcts_init(wq);
+    if (ret) {
+        zobrist_tt_free(&negamax_tt);
+        return ret;
+    }
+    tablebase_load(dev);
+    return 0;
+}
+
+static void variant_exit(void)
+{
+    mcts_exit();
+    zobrist_tt_free(&negamax_tt);
+    tablebase_free();
+}
+
+/* Both agents play from the tablebase when it knows the position, then from
+ * the opening book, and only search when neither does.
+ */
+static int known_move(char *table, char player)
+{
+    int move = tablebase_move(table, player);
+    return move < 0 ? book_move(table, player) : move;
+}
+
+static int mcts_move(char *table, char player)
+{
+    int move = known_move(table, player);
+    return move < 0 ? mcts(table, player) : move;
+}
+
+static int negamax_move(char *table, char player)
+{
+    int move = known_move(table, player);
+    return move < 0 ? negamax_predict_smp(&negamax_ctx, table, player).move
+                    : move;
+}
+
+const struct game_variant VARIANT_SYM(variant) = {
+    .name = VARIANT_NAME,
+    .board_size = BOARD_SIZE,
+    .goal = GOAL,
+    .init = variant_init,
+    .exit = variant_exit,
+    .judge = check_win,
+    .mcts_move = mcts_move,
+    .negamax_move = negamax_move,
+};
@@ -1,6 +1,9 @@
-#include <linux/slab.h>
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
 
 #include "game.h"
+#include "zobrist.h"
 
 const line_t lines[4] = {
     {1, 0, 0, 0, BOARD_SIZE - GOAL + 1, BOARD_SIZE},             // ROW
@@ -9,53 +12,193 @@ const line_t lines[4] = {
     {1, -1, 0, GOAL - 1, BOARD_SIZE - GOAL + 1, BOARD_SIZE},     // SECONDARY
 };
 
-static char check_line_segment_win(const char *t, int i, int j, line_t line)
-{
-    char last = t[GET_INDEX(i, j)];
-    if (last == ' ')
-        return ' ';
-    for (int k = 1; k < GOAL; k++) {
-        if (last != t[GET_INDEX(i + k * line.i_shift, j + k * line.j_shift)]) {
-            return ' ';
-        }
-    }
+bitboard_t win_masks[N_WIN_MASKS];
 #if !ALLOW_EXCEED
-    if (last == LOOKUP(t, i - line.i_shift, j - line.j_shift, ' ') ||
-        last ==
-            LOOKUP(t, i + GOAL * line.i_shift, j + GOAL * line.j_shift, ' '))
-        return ' ';
+bitboard_t win_borders[N_WIN_MASKS];
 #endif
-    return last;
+u8 grid_segs[N_GRIDS][MAX_SEGS_PER_GRID];
+u8 n_grid_segs[N_GRIDS];
+int pattern_score[GOAL + 1][GOAL + 1];
+u8 sym_grids[N_SYMMETRIES][N_GRIDS];
+u8 sym_grids_inv[N_SYMMETRIES][N_GRIDS];
+
+static bitboard_t grid_bit(int i, int j)
+{
+    if (i < 0 || i >= BOARD_SIZE || j < 0 || j >= BOARD_SIZE)
+        return 0;
+    return 1U << GET_INDEX(i, j);
 }
 
-char check_win(char *t)
+/* Unroll every segment walked by lines[] into a mask, so that a win is a
+ * single AND/compare instead of a nested scan of the table.
+ */
+void game_init(void)
 {
+    int n = 0;
     for (int i_line = 0; i_line < 4; ++i_line) {
         line_t line = lines[i_line];
         for (int i = line.i_lower_bound; i < line.i_upper_bound; ++i) {
             for (int j = line.j_lower_bound; j < line.j_upper_bound; ++j) {
-                char win = check_line_segment_win(t, i, j, line);
-                if (win != ' ')
-                    return win;
+                bitboard_t mask = 0;
+                for (int k = 0; k < GOAL; k++)
+                    mask |=
+                        grid_bit(i + k * line.i_shift, j + k * line.j_shift);
+                win_masks[n] = mask;
+#if !ALLOW_EXCEED
+                win_borders[n] =
+                    grid_bit(i - line.i_shift, j - line.j_shift) |
+                    grid_bit(i + GOAL * line.i_shift, j + GOAL * line.j_shift);
+#endif
+                n++;
+            }
+        }
+    }
+    BUG_ON(n != N_WIN_MASKS);
+
+    memset(n_grid_segs, 0, sizeof(n_grid_segs));
+    for (int s = 0; s < N_WIN_MASKS; s++) {
+        for (int i = 0; i < N_GRIDS; i++) {
+            if (win_masks[s] & (1U << i))
+                grid_segs[i][n_grid_segs[i]++] = s;
+        }
+    }
+
+    /* A segment holding c stones of a single side is worth 10^(c-1) to that
+     * side, and nothing once both sides have stones in it. The score only
+     * depends on the two counts, so it is tabulated by them, from the point
+     * of view of 'O'.
+     */
+    for (int o = 0; o <= GOAL; o++) {
+        for (int x = 0; x <= GOAL; x++) {
+            int score = 0;
+            for (int k = 0; k < o + x; k++)
+                score = score ? score * 10 : 1;
+            if (o && x)
+                score = 0;
+            pattern_score[o][x] = x ? -score : score;
+        }
+    }
+
+    /* Bit 2 transposes, bits 0 and 1 flip the row and column: the eight
+     * combinations are the dihedral group of the square.
+     */
+    for (int t = 0; t < N_SYMMETRIES; t++) {
+        for (int i = 0; i < BOARD_SIZE; i++) {
+            for (int j = 0; j < BOARD_SIZE; j++) {
+                int x = (t & 4) ? j : i, y = (t & 4) ? i : j;
+                if (t & 1)
+                    x = BOARD_SIZE - 1 - x;
+                if (t & 2)
+                    y = BOARD_SIZE - 1 - y;
+                sym_grids[t][GET_INDEX(i, j)] = GET_INDEX(x, y);
+                sym_grids_inv[t][GET_INDEX(x, y)] = GET_INDEX(i, j);
             }
         }
     }
+}
+
+void bitboard_from_table(const char *table, bitboard_t board[2])
+{
+    board[0] = board[1] = 0;
     for (int i = 0; i < N_GRIDS; i++)
-        if (t[i] == ' ')
-            return ' ';
-    return 'D';
+        if (table[i] != ' ')
+            bitboard_set(board, i, table[i]);
+}
+
+char check_win(char *t)
+{
+    bitboard_t board[2];
+    bitboard_from_table(t, board);
+    return bitboard_check_win(board);
+}
+
+void game_state_init(game_state_t *state, const char *table)
+{
+    memcpy(state->table, table, N_GRIDS);
+    bitboard_from_table(table, state->board);
+    state->n_empty = 0;
+    memset(state->keys, 0, sizeof(state->keys));
+    for (int i = 0; i < N_GRIDS; i++) {
+        if (table[i] == ' ') {
+            state->n_empty++;
+            continue;
+        }
+        for (int t = 0; t < N_SYMMETRIES; t++)
+            state->keys[t] ^=
+                zobrist_table[sym_grids[t][i]][PLAYER_INDEX(table[i])];
+    }
+    state->eval = 0;
+    for (int s = 0; s < N_WIN_MASKS; s++) {
+        int o = hweight32(state->board[0] & win_masks[s]);
+        int x = hweight32(state->board[1] & win_masks[s]);
+        state->line_count[0][s] = o;
+        state->line_count[1][s] = x;
+        state->eval += pattern_score[o][x];
+    }
+    state->winner = bitboard_check_win(state->board);
+}
+
+/* Only the segments through @move can become a win, and a win ends the game,
+ * so unmake_move() always restores an undecided position.
+ */
+void make_move(game_state_t *state, int move, char player)
+{
+    int p = PLAYER_INDEX(player);
+    char winner = ' ';
+
+    state->table[move] = player;
+    bitboard_set(state->board, move, player);
+    for (int t = 0; t < N_SYMMETRIES; t++)
+        state->keys[t] ^= zobrist_table[sym_grids[t][move]][p];
+    state->n_empty--;
+    for (int i = 0; i < n_grid_segs[move]; i++) {
+        int s = grid_segs[move][i];
+        u8 *o = &state->line_count[0][s], *x = &state->line_count[1][s];
+        state->eval -= pattern_score[*o][*x];
+        state->line_count[p][s]++;
+        state->eval += pattern_score[*o][*x];
+        if (state->line_count[p][s] < GOAL)
+            continue;
+#if !ALLOW_EXCEED
+        if (state->board[p] & win_borders[s])
+            continue;
+#endif
+        winner = player;
+    }
+    if (winner == ' ' && !state->n_empty)
+        winner = 'D';
+    state->winner = winner;
 }
 
-int *available_moves(const char *table)
+void unmake_move(game_state_t *state, int move, char player)
 {
-    int *moves = kzalloc(N_GRIDS * sizeof(int), __GFP_ZERO);
+    int p = PLAYER_INDEX(player);
+
+    state->table[move] = ' ';
+    bitboard_clear(state->board, move, player);
+    for (int t = 0; t < N_SYMMETRIES; t++)
+        state->keys[t] ^= zobrist_table[sym_grids[t][move]][p];
+    state->n_empty++;
+    for (int i = 0; i < n_grid_segs[move]; i++) {
+        int s = grid_segs[move][i];
+        u8 *o = &state->line_count[0][s], *x = &state->line_count[1][s];
+        state->eval -= pattern_score[*o][*x];
+        state->line_count[p][s]--;
+        state->eval += pattern_score[*o][*x];
+    }
+    state->winner = ' ';
+}
+
+/* Fill the caller-owned @moves with the empty grids of @state in ascending
+ * order and return how many there are.
+ */
+int available_moves(const game_state_t *state, int moves[N_GRIDS])
+{
+    bitboard_t empty = bitboard_available_moves(state->board);
     int m = 0;
-    for (int i = 0; i < N_GRIDS; i++)
-        if (table[i] == ' ')
-            moves[m++] = i;
-    if (m < N_GRIDS)
-        moves[m] = -1;
-    return moves;
+    for_each_grid_in_mask(i, empty)
+        moves[m++] = i;
+    return m;
 }
 
 Q23_8 calculate_win_value(char win, char player)
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <linux/types.h>
+
+#include "variant.h"
+
+/* Defaults to the 4x4 game; variant_*.c define their own before including */
+#ifndef BOARD_SIZE
 #define BOARD_SIZE 4
 #define GOAL 3
 #define ALLOW_EXCEED 1
+#endif
+
 #define N_GRIDS (BOARD_SIZE * BOARD_SIZE)
 #define GET_INDEX(i, j) ((i) * (BOARD_SIZE) + (j))
 #define GET_COL(x) ((x) % BOARD_SIZE)
@@ -12,6 +20,10 @@
     for (int i = 0; i < N_GRIDS; i++) \
         if (table[i] == ' ')
 
+/* Visit the grids set in @mask, lowest index first; @mask is consumed */
+#define for_each_grid_in_mask(i, mask) \
+    for (int i; (mask) && (i = __ffs(mask), 1); (mask) &= (mask) - 1)
+
 #define Q 8
 typedef unsigned int Q23_8;
 
@@ -20,7 +32,174 @@ typedef struct {
     int i_lower_bound, j_lower_bound, i_upper_bound, j_upper_bound;
 } line_t;
 
+/* One bit per grid, bit i set when GET_INDEX() == i is taken by the player.
+ * A position is a pair of bitboards indexed by PLAYER_INDEX(), the same
+ * order zobrist_table[][] uses.
+ */
+typedef u32 bitboard_t;
+
+#define BOARD_MASK ((bitboard_t) ((1ULL << N_GRIDS) - 1))
+#define PLAYER_INDEX(player) ((player) == 'X')
+
+/* Number of GOAL-length segments on the board, i.e. entries in win_masks */
+#define N_SEGS_PER_LINE (BOARD_SIZE - GOAL + 1)
+#define N_WIN_MASKS \
+    (2 * BOARD_SIZE * N_SEGS_PER_LINE + 2 * N_SEGS_PER_LINE * N_SEGS_PER_LINE)
+
+/* Rotations and reflections of the square board. sym_grids[t][i] is where
+ * grid i lands under symmetry t, sym_grids_inv[t] undoes it; t == 0 is the
+ * identity.
+ */
+#define N_SYMMETRIES 8
+
+/* A grid belongs to at most GOAL segments in each of the four directions */
+#define MAX_SEGS_PER_GRID (4 * GOAL)
+
 extern const line_t lines[4];
-int *available_moves(const char *table);
+extern bitboard_t win_masks[N_WIN_MASKS];
+#if !ALLOW_EXCEED
+extern bitboard_t win_borders[N_WIN_MASKS];
+#endif
+extern u8 grid_segs[N_GRIDS][MAX_SEGS_PER_GRID];
+extern u8 n_grid_segs[N_GRIDS];
+extern int pattern_score[GOAL + 1][GOAL + 1];
+extern u8 sym_grids[N_SYMMETRIES][N_GRIDS];
+extern u8 sym_grids_inv[N_SYMMETRIES][N_GRIDS];
+
+/* Position updated incrementally by make_move()/unmake_move().
+ *
+ * line_count[p][s] is the number of stones player p has in segment
+ * win_masks[s], so a move only has to look at the segments through it to
+ * know whether it wins. keys[t] is the Zobrist hash of the whole position
+ * transformed by symmetry t, so keys[0] is the plain key and the smallest one
+ * identifies the position up to symmetry. eval is the sum of pattern_score[]
+ * over all segments, the static evaluation of the position for 'O', kept up
+ * to date by the moves.
+ */
+typedef struct {
+    char table[N_GRIDS];
+    bitboard_t board[2];
+    u8 line_count[2][N_WIN_MASKS];
+    int n_empty;
+    u64 keys[N_SYMMETRIES];
+    int eval;
+    char winner; /* check_win() of the position */
+} game_state_t;
+
+void game_init(void);
 char check_win(char *t);
 Q23_8 calculate_win_value(char win, char player);
+
+void bitboard_from_table(const char *table, bitboard_t board[2]);
+
+int available_moves(const game_state_t *state, int moves[N_GRIDS]);
+void game_state_init(game_state_t *state, const char *table);
+void make_move(game_state_t *state, int move, char player);
+void unmake_move(game_state_t *state, int move, char player);
+
+static inline void bitboard_set(bitboard_t board[2], int move, char player)
+{
+    board[PLAYER_INDEX(player)] |= 1U << move;
+}
+
+static inline void bitboard_clear(bitboard_t board[2], int move, char player)
+{
+    board[PLAYER_INDEX(player)] &= ~(1U << move);
+}
+
+/* Empty grids of @board as a mask */
+static inline bitboard_t bitboard_available_moves(const bitboard_t board[2])
+{
+    return ~(board[0] | board[1]) & BOARD_MASK;
+}
+
+/* Same contract as check_win(): the winner, 'D' for a draw or ' ' */
+static inline char bitboard_check_win(const bitboard_t board[2])
+{
+    for (int i = 0; i < N_WIN_MASKS; i++) {
+        bitboard_t mask = win_masks[i];
+        for (int p = 0; p < 2; p++) {
+            if ((board[p] & mask) != mask)
+                continue;
+#if !ALLOW_EXCEED
+            if (board[p] & win_borders[i])
+                continue;
+#endif
+            return p ? 'X' : 'O';
+        }
+    }
+    return bitboard_available_moves(board) ? ' ' : 'D';
+}
+
+/* Empty grids where player @p would complete a segment and win at once,
+ * given the stones of @board counted per segment in @line_count. A segment is
+ * a threat when it holds GOAL - 1 stones of @p and none of the opponent, so
+ * its last grid is empty.
+ */
+static inline bitboard_t bitboard_threats(const bitboard_t board[2],
+                                          const u8 line_count[2][N_WIN_MASKS],
+                                          int p)
+{
+    bitboard_t threats = 0;
+    for (int s = 0; s < N_WIN_MASKS; s++) {
+        if (line_count[p][s] != GOAL - 1 || line_count[!p][s])
+            continue;
+#if !ALLOW_EXCEED
+        if (board[p] & win_borders[s])
+            continue;
+#endif
+        threats |= win_masks[s] & ~board[p];
+    }
+    return threats;
+}
+
+/* Pick the symmetry giving the canonical key of @state, store that key in
+ * @key and return the symmetry so moves can be mapped to and from the
+ * canonical frame with sym_grids[] and sym_grids_inv[].
+ */
+static inline int game_state_canonical(const game_state_t *state, u64 *key)
+{
+    int sym = 0;
+    for (int t = 1; t < N_SYMMETRIES; t++) {
+        if (state->keys[t] < state->keys[sym])
+            sym = t;
+    }
+    *key = state->keys[sym];
+    return sym;
+}
+
+/* Whether @player is to move in @board, as 'O' moves first */
+static inline bool bitboard_is_turn(const bitboard_t board[2], char player)
+{
+    return (int) hweight32(board[0]) - (int) hweight32(board[1]) ==
+           PLAYER_INDEX(player);
+}
+
+/* Store in @canon the canonical form of @board and return the symmetry that
+ * gives it, like game_state_canonical() but independent of the Zobrist keys,
+ * so that it can be computed offline. The canonical form has the smallest
+ * 'X' bitboard and then the smallest 'O' bitboard.
+ */
+static inline int bitboard_canonical(const bitboard_t board[2],
+                                     bitboard_t canon[2])
+{
+    int sym = 0;
+
+    canon[0] = board[0];
+    canon[1] = board[1];
+    for (int t = 1; t < N_SYMMETRIES; t++) {
+        bitboard_t sym_board[2] = {0, 0};
+        for (int p = 0; p < 2; p++) {
+            bitboard_t b = board[p];
+            for_each_grid_in_mask(i, b)
+                sym_board[p] |= 1U << sym_grids[t][i];
+        }
+        if (sym_board[1] < canon[1] ||
+            (sym_board[1] == canon[1] && sym_board[0] < canon[0])) {
+            canon[0] = sym_board[0];
+            canon[1] = sym_board[1];
+            sym = t;
+        }
+    }
+    return sym;
+}
@@ -1,217 +1,1058 @@
-#include <linux/slab.h>
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/overflow.h>
+#include <linux/random.h>
 #include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "game.h"
 #include "mcts.h"
+#include "mt19937-64.h"
+#include "param.h"
 #include "util.h"
 #include "wyhash.h"
 
-#define EXPLORATION_FACTOR fixed_sqrt(2 << Q)
-#define K (1 << (Q - 1))
+/* UCT uses the UCB1 bound score / n + sqrt(2 ln(n_total) / n). ln and
+ * 1 / sqrt are looked up in tables of UCT_TABLE_SIZE entries in Q16, so that
+ * a selection costs one square root and each child a division.
+ */
+#define UCT_TABLE_BITS 10
+#define UCT_TABLE_SIZE (1 << UCT_TABLE_BITS)
+#define UCT_FRAC 16
+#define UCT_LN2 45426 /* ln(2) in Q16 */
 
+static u32 uct_ln_table[UCT_TABLE_SIZE];
+static u32 uct_rsqrt_table[UCT_TABLE_SIZE];
+
+#define MCTS_MAX_WORKERS 64
+
+/* Playouts between two checks of the deadline and of the early stop rule */
+#define MCTS_CHECK_INTERVAL 256
+
+/* Tree nodes live in one arena per tree and refer to each other by index.
+ * The children of a node are allocated together, so they are the contiguous
+ * range [children, children + n_children). Index 0 is always the root, which
+ * is nobody's child, so children == 0 means the node is not expanded yet.
+ *
+ * Several workers may search the same tree. Statistics are then updated
+ * atomically; a visit is counted when a worker enters the node and its score
+ * when the playout comes back, which acts as a virtual loss steering the
+ * other workers elsewhere meanwhile. The first worker to swap children from 0
+ * to NODE_EXPANDING expands the node and publishes the range with a release
+ * store, the others treat the node as a leaf until then.
+ *
+ * Move orders reaching the same position share its children range, which
+ * the table of the tree finds by Zobrist key, so the tree is really a DAG.
+ * A node holds the statistics of the move into it from its parent, while the
+ * children hold those of the position itself, whichever way it is reached.
+ *
+ * amaf_score and amaf_visits count the playouts in which the move of the
+ * node was played later by the same player (all moves as first), for RAVE.
+ *
+ * proof is the outcome of the move with best play once it is known (MCTS-
+ * Solver): from a decided position, or from the children once one of them
+ * wins for the opponent or all of them are proven. A proven node is not
+ * searched any further and backs up its exact value.
+ */
 struct node {
-    int move;
+    atomic_t score;
+    atomic_t n_visits;
+    atomic_t amaf_score;
+    atomic_t amaf_visits;
+    u32 children;
+    u8 move;
+    u8 n_children;
+    u8 proof;
+};
+
+/* Ordered from worst to best for the player making the move */
+enum { PROOF_NONE, PROOF_LOSS, PROOF_DRAW, PROOF_WIN };
+
+#define NODE_EXPANDING U32_MAX
+
+/* Children range of an expanded position. The table has one entry per
+ * MCTS_TABLE_RATIO nodes and a position lives in one of the MCTS_PROBES
+ * slots after its key, or is not recorded if they are all taken.
+ */
+struct mcts_entry {
+    u64 key;
+    u32 children;
+    u8 n_children;
+};
+
+#define MCTS_TABLE_RATIO 4
+#define MCTS_PROBES 8
+
+/* The tree is kept from one call to the next. state is the position of its
+ * root in the frame of the moves stored in the tree, which may be a rotation
+ * or reflection of the position on the real board.
+ */
+struct mcts_tree {
+    struct node *nodes;
+    atomic_t n_nodes;
+    u32 capacity;
+    struct mcts_entry *table;
+    u32 table_mask;
+    game_state_t state;
+    char player;
+    bool valid;
+};
+
+/* A playout only needs the stones and their count per segment. picks[ply]
+ * is the index among the empty grids of the random move at ply. threats[p]
+ * holds the grids that won for player p when they were found; only the
+ * grids still empty are current.
+ */
+struct rollout {
+    bitboard_t board[2];
+    bitboard_t played[2];
+    bitboard_t threats[2];
+    u8 line_count[2][N_WIN_MASKS];
+    u8 picks[N_GRIDS];
+    u8 ply;
+    char player;
+    char winner;
+};
+
+/* @mover made the move into path[depth] */
+struct mcts_leaf {
+    struct node *path[N_GRIDS + 1];
+    int depth;
+    char mover;
+};
+
+/* Root parallelism: every worker grows its own tree from the same position
+ * and the visit counts of the root children are summed to pick the move.
+ * Tree parallelism: every worker searches the tree of worker 0 (shared).
+ */
+struct mcts_worker {
+    struct work_struct work;
+    struct mcts_tree tree;
+    struct mcts_tree *shared;
+    const game_state_t *board_state;
     char player;
-    int n_visits;
-    Q23_8 score;
-    struct node *parent;
-    struct node *children[N_GRIDS];
+    int iterations;
+    ktime_t deadline;
+    u32 capacity;
+    bool ok;
+    u64 rng;
+    struct mcts_leaf leaf;
+    struct rollout rollout;
 };
 
-static struct node *new_node(int move, char player, struct node *parent)
+static struct mcts_worker workers[MCTS_MAX_WORKERS];
+static struct workqueue_struct *mcts_wq;
+
+static struct node *new_nodes(struct mcts_tree *tree, int n)
 {
-    struct node *node = kzalloc(sizeof(struct node), __GFP_ZERO);
-    node->move = move;
-    node->player = player;
-    node->n_visits = 0;
-    node->score = 0;
-    node->parent = parent;
-    memset(node->children, 0, sizeof(node->children));
-    return node;
+    if ((u32) atomic_read(&tree->n_nodes) + n > tree->capacity)
+        return NULL;
+    u32 first = atomic_add_return(n, &tree->n_nodes) - n;
+    if (first + n > tree->capacity)
+        return NULL;
+    struct node *nodes = &tree->nodes[first];
+    memset(nodes, 0, n * sizeof(struct node));
+    return nodes;
 }
 
-static void free_node(struct node *node)
+/* Return the children of the position with key @key if it was expanded
+ * already, or 0
+ */
+static u32 table_find(const struct mcts_tree *tree, u64 key, u8 *n_children)
 {
-    for (int i = 0; i < N_GRIDS; i++)
-        if (node->children[i])
-            free_node(node->children[i]);
-    kfree(node);
+    for (int i = 0; i < MCTS_PROBES; i++) {
+        struct mcts_entry *e = &tree->table[(key + i) & tree->table_mask];
+        if (READ_ONCE(e->key) != key)
+            continue;
+        u32 children = smp_load_acquire(&e->children);
+        if (children) {
+            *n_children = e->n_children;
+            return children;
+        }
+    }
+    return 0;
 }
 
-Q23_8 fixed_sqrt(Q23_8 x)
+/* Key 0 marks an empty slot, the empty board is never a child anyway */
+static void table_insert(struct mcts_tree *tree,
+                         u64 key,
+                         u32 children,
+                         u8 n_children)
 {
-    if (x <= 1 << Q) /* Assume x is always positive */
-        return x;
+    if (!key)
+        return;
+    for (int i = 0; i < MCTS_PROBES; i++) {
+        struct mcts_entry *e = &tree->table[(key + i) & tree->table_mask];
+        if (READ_ONCE(e->key) || cmpxchg64(&e->key, 0, key))
+            continue;
+        e->n_children = n_children;
+        smp_store_release(&e->children, children);
+        return;
+    }
+}
+
+static void tree_free(struct mcts_tree *tree)
+{
+    vfree(tree->nodes);
+    vfree(tree->table);
+    tree->nodes = NULL;
+    tree->table = NULL;
+    tree->valid = false;
+}
 
-    Q23_8 z = 0;
-    for (Q23_8 m = 1UL << ((31 - __builtin_clz(x)) & ~1UL); m; m >>= 2) {
-        int b = z + m;
-        z >>= 1;
-        if (x >= b)
-            x -= b, z += m;
+/* The arena is only allocated for variants that get played */
+static bool tree_reset(struct mcts_tree *tree, u32 capacity)
+{
+    if (tree->nodes && tree->capacity != capacity)
+        tree_free(tree);
+    if (!tree->nodes) {
+        u32 n_entries = roundup_pow_of_two(capacity / MCTS_TABLE_RATIO + 1);
+        tree->nodes = vmalloc(array_size(capacity, sizeof(struct node)));
+        tree->table =
+            vmalloc(array_size(n_entries, sizeof(struct mcts_entry)));
+        if (!tree->nodes || !tree->table) {
+            tree_free(tree);
+            return false;
+        }
+        tree->capacity = capacity;
+        tree->table_mask = n_entries - 1;
     }
-    z = z << Q / 2;
-    return z;
+    memset(tree->table, 0,
+           (tree->table_mask + 1) * sizeof(struct mcts_entry));
+    atomic_set(&tree->n_nodes, 0);
+    tree->valid = false;
+    return true;
 }
 
-Q23_8 fixed_div(Q23_8 a, Q23_8 b)
+/* Make @root the root of the arena, dropping every node it does not lead
+ * to. The nodes are copied breadth first so that each child range stays
+ * contiguous and the new root lands on index 0; map[] remembers where each
+ * range went so that shared ranges are copied once and the table can follow.
+ */
+static bool tree_keep(struct mcts_tree *tree, const struct node *root)
 {
-    /* pre-multiply by the base (Upscale to Q16 so that the result will be in Q8
-     * format) */
-    unsigned long temp = (unsigned long) a << Q;
-    /* Rounding: mid values are rounded up (down for negative values). */
-    /* OR compare most significant bits i.e. if (((temp >> 31) & 1) == ((b >>
-     * 15) & 1)) */
+    u32 n_nodes = atomic_read(&tree->n_nodes);
+    struct node *nodes = vmalloc(array_size(n_nodes, sizeof(struct node)));
+    u32 *map = vzalloc(array_size(n_nodes, sizeof(u32)));
+    if (!nodes || !map) {
+        vfree(nodes);
+        vfree(map);
+        return false;
+    }
 
-    temp += b / 2; /* OR shift 1 bit i.e. temp += (b >> 1); */
+    u32 n = 1;
+    nodes[0] = *root;
+    for (u32 i = 0; i < n; i++) {
+        struct node *node = &nodes[i];
+        u32 children = node->children;
+        if (!children)
+            continue;
+        if (!map[children]) {
+            memcpy(&nodes[n], &tree->nodes[children],
+                   node->n_children * sizeof(struct node));
+            map[children] = n;
+            n += node->n_children;
+        }
+        node->children = map[children];
+    }
+    memcpy(tree->nodes, nodes, n * sizeof(struct node));
+    atomic_set(&tree->n_nodes, n);
 
-    return (Q23_8) (temp / b);
+    for (u32 i = 0; i <= tree->table_mask; i++) {
+        struct mcts_entry *e = &tree->table[i];
+        e->children = e->key ? map[e->children] : 0;
+        if (!e->children)
+            e->key = 0;
+    }
+    vfree(map);
+    vfree(nodes);
+    return true;
 }
 
-Q23_8 fixed_log(int input)
+/* Walk @depth plies down from @node looking for the position whose canonical
+ * key is @key, playing the moves on tree->state. On success tree->state is
+ * left at the position found.
+ */
+static struct node *find_position(struct mcts_tree *tree,
+                                  struct node *node,
+                                  int depth,
+                                  char player,
+                                  u64 key)
 {
-    if (!input || input == 1)
-        return 0;
+    u64 node_key;
+    game_state_canonical(&tree->state, &node_key);
+    if (!depth)
+        return node_key == key ? node : NULL;
+
+    struct node *child = &tree->nodes[node->children];
+    for (int i = 0; i < node->n_children; i++, child++) {
+        make_move(&tree->state, child->move, player);
+        struct node *found =
+            find_position(tree, child, depth - 1, player ^ 'O' ^ 'X', key);
+        if (found)
+            return found;
+        unmake_move(&tree->state, child->move, player);
+    }
+    return NULL;
+}
 
-    Q23_8 y = input << Q;  // int to Q15_16
-    Q23_8 L = 1L << ((31 - __builtin_clz(y))), R = L << 1;
-    Q23_8 Llog = (31 - __builtin_clz(y) - Q) << Q, Rlog = Llog + (1 << Q), log;
-
-    for (int i = 1; i < 20; i++) {
-        if (y == L)
-            return Llog;
-        else if (y == R)
-            return Rlog;
-        log = fixed_div(Llog + Rlog, 2 << Q);
-
-        unsigned long tmp = ((unsigned long) L * (unsigned long) R) >> Q;
-        tmp = fixed_sqrt((Q23_8) tmp);
-
-        if (y >= tmp) {
-            L = tmp;
-            Llog = log;
-        } else {
-            R = tmp;
-            Rlog = log;
+/* Continue from the previous tree if @state is reachable from its root by
+ * our last move and the reply to it, otherwise start a new one.
+ */
+static bool tree_reuse(struct mcts_tree *tree,
+                       const game_state_t *state,
+                       char player,
+                       u32 capacity)
+{
+    u64 key;
+    game_state_canonical(state, &key);
+    if (tree->valid && tree->capacity == capacity && tree->player == player &&
+        tree->state.n_empty - state->n_empty == 2) {
+        struct node *root = find_position(tree, tree->nodes, 2, player, key);
+        if (root && tree_keep(tree, root))
+            return true;
+    }
+
+    if (!tree_reset(tree, capacity))
+        return false;
+    tree->state = *state;
+    tree->player = player;
+    tree->valid = true;
+    new_nodes(tree, 1);
+    return true;
+}
+
+/* ln(n) in Q16, from log2(n) by repeated squaring of the mantissa */
+static u32 uct_ln_calc(u32 n)
+{
+    int ip = ilog2(n);
+    u64 y = ((u64) n << 31) >> ip; /* Q31, in [1, 2) */
+    u32 lg = ip << UCT_FRAC;
+    for (int bit = UCT_FRAC - 1; bit >= 0; bit--) {
+        y = (y * y) >> 31;
+        if (y >= 2ULL << 31) {
+            y >>= 1;
+            lg |= 1U << bit;
         }
     }
+    return ((u64) lg * UCT_LN2) >> UCT_FRAC;
+}
 
-    return (Q23_8) log;
+static inline u32 uct_ln(u32 n);
+static inline u32 uct_rsqrt(u32 n);
+static inline u32 uct_exploration(int n_total);
+
+/* ln(n), 1 / sqrt(n) and sqrt(2 ln(n)) in Q16, rounded from libm */
+static const struct {
+    u32 n, ln, rsqrt, exploration;
+} uct_reference[] = {
+    {1, 0, 65536, 0},
+    {2, 45426, 46341, 77163},
+    {3, 71999, 37837, 97144},
+    {10, 150902, 20724, 140638},
+    {100, 301804, 6554, 198892},
+    {1000, 452707, 2072, 243592},
+    {1023, 454197, 2049, 243993},
+    {1024, 454261, 2048, 244010},
+    {1500, 479279, 1692, 250639},
+    {4096, 545113, 1024, 267300},
+    {100000, 754511, 207, 314476},
+    {1000000, 905413, 66, 344491},
+    {2147483647, 1408209, 1, 429624},
+};
+
+/* Error bounds in Q16 steps. Within the tables ln is exact to a few steps
+ * and 1 / sqrt to one. Scaling a larger argument down costs ln up to
+ * ln(1 + 2 / UCT_TABLE_SIZE), 1 / sqrt up to three steps, and sqrt(2 ln(n))
+ * what the ln error becomes through the square root.
+ */
+#define UCT_LN_TOL 3
+#define UCT_RSQRT_TOL 1
+#define UCT_EXPLORATION_TOL 4
+#define UCT_SCALED_LN_TOL (UCT_LN_TOL + (2 << UCT_FRAC) / UCT_TABLE_SIZE)
+#define UCT_SCALED_RSQRT_TOL 3
+#define UCT_SCALED_EXPLORATION_TOL 36
+
+static bool uct_close(const char *name, u32 n, u32 value, u32 ref, u32 tol)
+{
+    if ((value > ref ? value - ref : ref - value) <= tol)
+        return true;
+    pr_err("simrupt: %s(%u) is %u in Q16, expected %u +/- %u\n", name, n,
+           value, ref, tol);
+    return false;
+}
+
+/* Check the tables once against uct_reference[] */
+static int uct_selftest(void)
+{
+    bool ok = true;
+
+    for (int i = 0; i < ARRAY_SIZE(uct_reference); i++) {
+        u32 n = uct_reference[i].n;
+        bool scaled = n >= UCT_TABLE_SIZE;
+        ok &= uct_close("ln", n, uct_ln(n), uct_reference[i].ln,
+                        scaled ? UCT_SCALED_LN_TOL : UCT_LN_TOL);
+        ok &= uct_close("rsqrt", n, uct_rsqrt(n), uct_reference[i].rsqrt,
+                        scaled ? UCT_SCALED_RSQRT_TOL : UCT_RSQRT_TOL);
+        ok &= uct_close("exploration", n, uct_exploration(n),
+                        uct_reference[i].exploration,
+                        scaled ? UCT_SCALED_EXPLORATION_TOL
+                               : UCT_EXPLORATION_TOL);
+    }
+    return ok ? 0 : -EINVAL;
+}
+
+static int uct_init(void)
+{
+    for (u32 n = 1; n < UCT_TABLE_SIZE; n++) {
+        uct_ln_table[n] = uct_ln_calc(n);
+        uct_rsqrt_table[n] = int_sqrt64(div_u64(1ULL << (2 * UCT_FRAC), n));
+    }
+    return uct_selftest();
+}
+
+/* Arguments beyond the tables are scaled down by a power of two, which costs
+ * ln(1 + 2 / UCT_TABLE_SIZE) at most.
+ */
+static inline u32 uct_ln(u32 n)
+{
+    if (n < UCT_TABLE_SIZE)
+        return uct_ln_table[n];
+    int shift = ilog2(n) - UCT_TABLE_BITS + 1;
+    return uct_ln_table[n >> shift] + shift * UCT_LN2;
+}
+
+static inline u32 uct_rsqrt(u32 n)
+{
+    if (n < UCT_TABLE_SIZE)
+        return uct_rsqrt_table[n];
+    int shift = (ilog2(n) - UCT_TABLE_BITS) / 2 + 1;
+    return uct_rsqrt_table[n >> (2 * shift)] >> shift;
+}
+
+/* sqrt(2 ln(n_total)) in Q16, shared by all the children of a node */
+static inline u32 uct_exploration(int n_total)
+{
+    if (n_total <= 1)
+        return 0;
+    return int_sqrt64((u64) uct_ln(n_total) << (UCT_FRAC + 1));
 }
 
-static inline Q23_8 uct_score(int n_total, int n_visits, Q23_8 score)
+/* The mean score of the child plus exploration / sqrt(n_visits), in Q23_8 */
+/* With RAVE, the mean score is blended with the AMAF mean by the weight
+ * beta = m / (n + m + n * m / rave) of Silver's schedule, where m counts the
+ * AMAF playouts. beta starts around 1/2 and falls to about rave / n once n
+ * outgrows rave.
+ */
+static inline Q23_8 uct_score(u32 exploration,
+                              const struct node *child,
+                              u32 rave)
 {
+    int n_visits = atomic_read(&child->n_visits);
     if (n_visits == 0)
-        return 0xffffffff;
-    Q23_8 result = score << Q / (Q23_8) (n_visits << Q);
-    unsigned long tmp =
-        (unsigned long) EXPLORATION_FACTOR *
-        (unsigned long) fixed_sqrt(fixed_log(n_total) / n_visits);
-    Q23_8 resultN = tmp >> Q;
-    return result + resultN;
+        return U32_MAX;
+    Q23_8 mean = (Q23_8) atomic_read(&child->score) / n_visits;
+    int amaf_visits = rave ? atomic_read(&child->amaf_visits) : 0;
+    if (amaf_visits) {
+        Q23_8 amaf = (Q23_8) atomic_read(&child->amaf_score) / amaf_visits;
+        u64 m = amaf_visits;
+        u64 beta = div64_u64(m << UCT_FRAC,
+                             n_visits + m + div_u64(n_visits * m, rave));
+        mean = (mean * ((1ULL << UCT_FRAC) - beta) + amaf * beta) >> UCT_FRAC;
+    }
+    u64 bonus = (u64) exploration * uct_rsqrt(n_visits);
+    return mean + (Q23_8) (bonus >> (2 * UCT_FRAC - Q));
 }
 
-static struct node *select_move(struct node *node)
+/* Pick the child to descend into and count the visit right away. A proven
+ * win is always taken and proven losses are never, so NULL means all moves
+ * lose.
+ */
+static struct node *select_move(struct mcts_tree *tree,
+                                struct node *node,
+                                u32 children,
+                                u32 rave,
+                                int *n_visits)
 {
+    struct node *child = &tree->nodes[children];
     struct node *best_node = NULL;
     Q23_8 best_score = 0;
-    for (int i = 0; i < N_GRIDS; i++) {
-        if (!node->children[i])
+
+    /* The position may be reached through other parents too, so its visits
+     * are those of its children rather than of @node.
+     */
+    int n_total = 0;
+    for (int i = 0; i < node->n_children; i++)
+        n_total += atomic_read(&child[i].n_visits);
+    u32 exploration = uct_exploration(n_total);
+    for (int i = 0; i < node->n_children; i++, child++) {
+        u8 proof = READ_ONCE(child->proof);
+        if (proof == PROOF_WIN) {
+            best_node = child;
+            break;
+        }
+        if (proof == PROOF_LOSS)
             continue;
-        Q23_8 score = uct_score(node->n_visits, node->children[i]->n_visits,
-                                node->children[i]->score);
-        if (score > best_score) {
+        Q23_8 score = uct_score(exploration, child, rave);
+        if (!best_node || score > best_score) {
             best_score = score;
-            best_node = node->children[i];
+            best_node = child;
         }
     }
+    if (best_node)
+        *n_visits = atomic_inc_return(&best_node->n_visits);
     return best_node;
 }
 
-static Q23_8 simulate(char *table, char player)
+static void rollout_init(struct rollout *r,
+                         const game_state_t *state,
+                         char player,
+                         bool tactical,
+                         u64 *rng)
 {
-    char current_player = player;
-    char temp_table[N_GRIDS];
-    memcpy(temp_table, table, N_GRIDS);
-    while (1) {
-        int *moves = available_moves(temp_table);
-        if (moves[0] == -1) {
-            kfree(moves);
-            break;
+    memcpy(r->board, state->board, sizeof(r->board));
+    memcpy(r->line_count, state->line_count, sizeof(r->line_count));
+    r->played[0] = r->played[1] = 0;
+    r->threats[0] = r->threats[1] = 0;
+    if (tactical) {
+        r->threats[0] = bitboard_threats(r->board, r->line_count, 0);
+        r->threats[1] = bitboard_threats(r->board, r->line_count, 1);
+    }
+    r->ply = 0;
+    r->player = player;
+    r->winner = ' ';
+    wyhash64_fill_bounded(rng, r->picks, state->n_empty, state->n_empty);
+}
+
+/* Play one random move of @r and return whether the playout goes on. With
+ * @tactical, a player who can win at once does, and one who cannot blocks the
+ * first immediate win of the opponent, which also ends the playout as soon as
+ * the outcome is forced. The moves of each player are added to r->played.
+ */
+static bool rollout_step(struct rollout *r, bool tactical)
+{
+    int p = PLAYER_INDEX(r->player);
+    bitboard_t empty = bitboard_available_moves(r->board);
+    bitboard_t move_mask = 0;
+
+    if (tactical) {
+        bitboard_t wins = r->threats[p] & empty;
+        if (wins) {
+            r->played[p] |= 1U << __ffs(wins);
+            r->winner = r->player;
+            return false;
         }
-        int n_moves = 0;
-        while (n_moves < N_GRIDS && moves[n_moves] != -1)
-            ++n_moves;
-        int move = moves[wyhash64() % n_moves];
-        kfree(moves);
-        temp_table[move] = current_player;
-        char win;
-        if ((win = check_win(temp_table)) != ' ')
-            return calculate_win_value(win, player);
-        current_player ^= 'O' ^ 'X';
+        move_mask = r->threats[!p] & empty;
+    }
+    if (!move_mask) {
+        move_mask = empty;
+        for (int k = r->picks[r->ply]; k; k--)
+            move_mask &= move_mask - 1;
+    }
+
+    int move = __ffs(move_mask);
+    r->ply++;
+    r->board[p] |= 1U << move;
+    r->played[p] |= 1U << move;
+    for (int i = 0; i < n_grid_segs[move]; i++) {
+        int s = grid_segs[move][i];
+        if (++r->line_count[p][s] < GOAL) {
+            /* A threat of the opponent can only be blocked by filling its
+             * grid, so only new threats have to be recorded.
+             */
+            if (r->line_count[p][s] == GOAL - 1 && !r->line_count[!p][s])
+                r->threats[p] |= win_masks[s] & ~r->board[p];
+            continue;
+        }
+#if !ALLOW_EXCEED
+        if (r->board[p] & win_borders[s])
+            continue;
+#endif
+        r->winner = r->player;
+    }
+#if !ALLOW_EXCEED
+    /* A stone next to a segment also spoils it, so start over */
+    if (tactical) {
+        r->threats[0] = bitboard_threats(r->board, r->line_count, 0);
+        r->threats[1] = bitboard_threats(r->board, r->line_count, 1);
+    }
+#endif
+    if (r->winner == ' ' && !bitboard_available_moves(r->board))
+        r->winner = 'D';
+    r->player ^= 'O' ^ 'X';
+    return r->winner == ' ';
+}
+
+/* Play @r out to the end of the game */
+static void rollout_run(struct rollout *r, bool tactical)
+{
+    while (rollout_step(r, tactical))
+        ;
+}
+
+/* The visits along @path were counted on the way down. @score is for the
+ * player who moved into the last node and alternates going up.
+ */
+static void backpropagate(struct node **path, int depth, Q23_8 score)
+{
+    while (depth >= 0) {
+        struct node *node = path[depth--];
+        atomic_add(score, &node->score);
+        score = (1U << Q) - score;
     }
-    return 0.5;
 }
 
-static void backpropagate(struct node *node, Q23_8 score)
+/* Credit every sibling along @path whose move the same player made later in
+ * the episode. @played holds the moves made below path[depth], @mover is
+ * the player who moved into path[depth] and @score is for @mover.
+ */
+static void rave_update(struct mcts_tree *tree,
+                        struct node **path,
+                        int depth,
+                        Q23_8 score,
+                        char mover,
+                        bitboard_t played[2])
 {
-    while (node) {
-        node->n_visits++;
-        node->score += score;
-        node = node->parent;
-        score = 1 - score;
+    for (; depth > 0; depth--) {
+        int p = PLAYER_INDEX(mover);
+        struct node *parent = path[depth - 1];
+        struct node *child = &tree->nodes[parent->children];
+        played[p] |= 1U << path[depth]->move;
+        for (int i = 0; i < parent->n_children; i++, child++) {
+            if (!(played[p] & (1U << child->move)))
+                continue;
+            atomic_add(score, &child->amaf_score);
+            atomic_inc(&child->amaf_visits);
+        }
+        score = (1U << Q) - score;
+        mover ^= 'O' ^ 'X';
     }
 }
 
-static void expand(struct node *node, char *table)
+/* Return the index of the children of @node, expanding it if needed, or 0 when
+ * it has none yet: another worker is expanding it or the arena is full.
+ *
+ * A position already expanded through another move order hands over its
+ * children. Otherwise, moves leading to positions that are equal up to
+ * symmetry have the same value, so only the first of them gets a child.
+ * Nothing is expanded once the arena is full; the search then keeps refining
+ * the existing tree.
+ */
+static u32 expand(struct mcts_tree *tree,
+                  struct node *node,
+                  game_state_t *state,
+                  char player)
 {
-    int *moves = available_moves(table);
-    int n_moves = 0;
-    while (n_moves < N_GRIDS && moves[n_moves] != -1)
-        ++n_moves;
+    u32 children = smp_load_acquire(&node->children);
+    if (children)
+        return children == NODE_EXPANDING ? 0 : children;
+    if (cmpxchg(&node->children, 0, NODE_EXPANDING))
+        return 0;
+
+    u8 n_shared;
+    children = table_find(tree, state->keys[0], &n_shared);
+    if (children) {
+        node->n_children = n_shared;
+        smp_store_release(&node->children, children);
+        return children;
+    }
+    if ((u32) atomic_read(&tree->n_nodes) >= tree->capacity) {
+        smp_store_release(&node->children, 0);
+        return 0;
+    }
+
+    int moves[N_GRIDS];
+    u64 keys[N_GRIDS];
+    int n_moves = available_moves(state, moves), n_children = 0;
     for (int i = 0; i < n_moves; i++) {
-        node->children[i] = new_node(moves[i], node->player ^ 'O' ^ 'X', node);
+        u64 key;
+        int j;
+        make_move(state, moves[i], player);
+        game_state_canonical(state, &key);
+        unmake_move(state, moves[i], player);
+        for (j = 0; j < n_children && keys[j] != key; j++)
+            ;
+        if (j < n_children)
+            continue;
+        keys[n_children] = key;
+        moves[n_children++] = moves[i];
+    }
+
+    struct node *nodes = new_nodes(tree, n_children);
+    if (!nodes) {
+        smp_store_release(&node->children, 0);
+        return 0;
     }
-    kfree(moves);
+    for (int i = 0; i < n_children; i++)
+        nodes[i].move = moves[i];
+    node->n_children = n_children;
+    children = nodes - tree->nodes;
+    table_insert(tree, state->keys[0], children, n_children);
+    smp_store_release(&node->children, children);
+    return children;
 }
 
-int mcts(char *table, char player)
+/* The search can stop once the deadline has passed, or once the most visited
+ * root child keeps its lead even if all the playouts left in the budget went
+ * to the runner-up. Without a deadline the budget is what is left of
+ * @iterations; with one it is further limited by extrapolating the playout
+ * rate since @start to the time left.
+ */
+static bool search_done(struct mcts_tree *tree,
+                        int iterations,
+                        ktime_t deadline,
+                        ktime_t start,
+                        int start_visits)
 {
-    char win;
-    struct node *root = new_node(-1, player, NULL);
-    for (int i = 0; i < ITERATIONS; i++) {
-        struct node *node = root;
-        char temp_table[N_GRIDS];
-        memcpy(temp_table, table, N_GRIDS);
-        while (1) {
-            if ((win = check_win(temp_table)) != ' ') {
-                Q23_8 score =
-                    calculate_win_value(win, node->player ^ 'O' ^ 'X');
-                backpropagate(node, score);
-                break;
-            }
-            if (node->n_visits == 0) {
-                Q23_8 score = simulate(temp_table, node->player);
-                backpropagate(node, score);
+    struct node *root = tree->nodes;
+    int visits = atomic_read(&root->n_visits);
+    s64 remaining = iterations - visits;
+
+    if (deadline) {
+        ktime_t now = ktime_get();
+        if (ktime_after(now, deadline))
+            return true;
+        s64 elapsed = ktime_to_ns(ktime_sub(now, start));
+        s64 left = ktime_to_ns(ktime_sub(deadline, now));
+        if (elapsed > 0)
+            remaining = min(remaining,
+                            div64_s64((s64) (visits - start_visits) * left,
+                                      elapsed) + 1);
+    }
+
+    u32 children = smp_load_acquire(&root->children);
+    if (!children || children == NODE_EXPANDING || root->n_children < 2)
+        return false;
+    int best = 0, second = 0;
+    struct node *child = &tree->nodes[children];
+    for (int i = 0; i < root->n_children; i++, child++) {
+        int n = atomic_read(&child->n_visits);
+        if (n > best) {
+            second = best;
+            best = n;
+        } else if (n > second) {
+            second = n;
+        }
+    }
+    return best - second > remaining;
+}
+
+/* The proof of the move into @node as far as its children tell */
+static u8 prove(const struct mcts_tree *tree, const struct node *node)
+{
+    u32 children = smp_load_acquire(&node->children);
+    u8 best = PROOF_LOSS;
+
+    if (!children || children == NODE_EXPANDING)
+        return PROOF_NONE;
+    const struct node *child = &tree->nodes[children];
+    for (int i = 0; i < node->n_children; i++, child++) {
+        u8 proof = READ_ONCE(child->proof);
+        if (proof == PROOF_WIN)
+            return PROOF_LOSS;
+        if (proof == PROOF_NONE)
+            return PROOF_NONE;
+        best = max(best, proof);
+    }
+    /* The best outcome of the opponent is the worst of the mover */
+    return PROOF_WIN + PROOF_LOSS - best;
+}
+
+/* Prove path[depth] and its ancestors for as long as their children decide
+ * them.
+ */
+static void solve(struct mcts_tree *tree, struct node **path, int depth)
+{
+    for (; depth >= 0; depth--) {
+        u8 proof = prove(tree, path[depth]);
+        if (!proof)
+            return;
+        WRITE_ONCE(path[depth]->proof, proof);
+    }
+}
+
+static Q23_8 proof_value(u8 proof)
+{
+    if (proof == PROOF_WIN)
+        return 1U << Q;
+    if (proof == PROOF_LOSS)
+        return 0;
+    return 1U << (Q - 1);
+}
+
+/* Back up @score, for the player who moved into the leaf */
+static void leaf_update(struct mcts_tree *tree,
+                        struct mcts_leaf *leaf,
+                        Q23_8 score,
+                        bitboard_t played[2],
+                        u32 rave)
+{
+    backpropagate(leaf->path, leaf->depth, score);
+    if (rave)
+        rave_update(tree, leaf->path, leaf->depth, score, leaf->mover, played);
+}
+
+/* Walk down from the root of @tree, counting the visits on the way, to a
+ * position that is decided or proven, visited for the first time or not
+ * expanded (yet), and record the path in @leaf. Return true if the leaf needs
+ * a playout, which is then set up in @r; a known outcome is backed up right
+ * away, after proving the nodes it decides.
+ */
+static bool descend(struct mcts_tree *tree,
+                    struct mcts_leaf *leaf,
+                    struct rollout *r,
+                    bool tactical,
+                    u32 rave,
+                    u64 *rng)
+{
+    game_state_t state = tree->state;
+    struct node *node = tree->nodes;
+    int n_visits = atomic_inc_return(&node->n_visits);
+    char to_move = tree->player;
+    int depth = 0;
+
+    leaf->path[0] = node;
+    while (state.winner == ' ' && !READ_ONCE(node->proof) && n_visits > 1) {
+        u32 children = expand(tree, node, &state, to_move);
+        if (!children)
+            break;
+        struct node *child =
+            select_move(tree, node, children, rave, &n_visits);
+        if (!child) {
+            /* Every move loses, which proves @node */
+            solve(tree, leaf->path, depth);
+            continue;
+        }
+        node = child;
+        make_move(&state, node->move, to_move);
+        to_move ^= 'O' ^ 'X';
+        leaf->path[++depth] = node;
+    }
+    leaf->depth = depth;
+    leaf->mover = to_move ^ 'O' ^ 'X';
+
+    u8 proof = READ_ONCE(node->proof);
+    if (state.winner != ' ' && !proof && depth) {
+        proof = state.winner == 'D' ? PROOF_DRAW : PROOF_WIN;
+        WRITE_ONCE(node->proof, proof);
+    }
+    /* A node proven through a transposition or by another worker has not
+     * been backed up into this path yet.
+     */
+    if (proof && depth)
+        solve(tree, leaf->path, depth - 1);
+    if (!proof) {
+        rollout_init(r, &state, to_move, tactical, rng);
+        return true;
+    }
+
+    bitboard_t played[2] = {0, 0};
+    leaf_update(tree, leaf, proof_value(proof), played, rave);
+    return false;
+}
+
+/* Run playouts until the root of @tree has been visited as many times as @w
+ * asks for, its outcome is proven or search_done() says the choice is
+ * settled.
+ */
+static void search(struct mcts_tree *tree, struct mcts_worker *w)
+{
+    struct node *root = tree->nodes;
+    ktime_t start = ktime_get();
+    int start_visits = atomic_read(&root->n_visits);
+    bool tactical = READ_ONCE(mcts_tactical);
+    u32 rave = READ_ONCE(mcts_rave);
+    int since_check = 0;
+
+    while (atomic_read(&root->n_visits) < w->iterations &&
+           !READ_ONCE(root->proof)) {
+        if (since_check >= MCTS_CHECK_INTERVAL) {
+            since_check = 0;
+            if (search_done(tree, w->iterations, w->deadline, start,
+                            start_visits))
                 break;
-            }
-            if (node->children[0] == NULL)
-                expand(node, temp_table);
-            node = select_move(node);
-            temp_table[node->move] = node->player ^ 'O' ^ 'X';
         }
+        since_check++;
+        if (!descend(tree, &w->leaf, &w->rollout, tactical, rave, &w->rng))
+            continue;
+        rollout_run(&w->rollout, tactical);
+        Q23_8 score = calculate_win_value(w->rollout.winner, w->leaf.mover);
+        leaf_update(tree, &w->leaf, score, w->rollout.played, rave);
     }
-    struct node *best_node = NULL;
-    int most_visits = -1;
-    for (int i = 0; i < N_GRIDS; i++) {
-        if (root->children[i] && root->children[i]->n_visits > most_visits) {
-            most_visits = root->children[i]->n_visits;
-            best_node = root->children[i];
+}
+
+static void worker_func(struct work_struct *work)
+{
+    struct mcts_worker *w = container_of(work, struct mcts_worker, work);
+
+    if (w->shared) {
+        search(w->shared, w);
+        return;
+    }
+    w->ok = tree_reuse(&w->tree, w->board_state, w->player, w->capacity);
+    if (w->ok)
+        search(&w->tree, w);
+}
+
+/* Playouts draw from a generator private to their worker, seeded once here.
+ * A non-zero mcts_seed seeds them through MT19937 for reproducible runs.
+ * Fails if the UCT tables do not pass their self-check.
+ */
+int mcts_init(struct workqueue_struct *wq)
+{
+    u64 seed = READ_ONCE(mcts_seed);
+    int ret;
+
+    if (seed)
+        mt19937_init(seed);
+    ret = uct_init();
+    if (ret)
+        return ret;
+    mcts_wq = wq;
+    for (int i = 0; i < MCTS_MAX_WORKERS; i++) {
+        workers[i].rng = seed ? mt19937_rand() : get_random_u64();
+        INIT_WORK(&workers[i].work, worker_func);
+        workers[i].tree.nodes = NULL;
+        workers[i].tree.table = NULL;
+        workers[i].tree.valid = false;
+    }
+    return 0;
+}
+
+void mcts_exit(void)
+{
+    for (int i = 0; i < MCTS_MAX_WORKERS; i++)
+        tree_free(&workers[i].tree);
+}
+
+/* The first free grid, for when the search has no move to offer */
+static int first_free_grid(const char *table)
+{
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] == ' ')
+            return i;
+    return -1;
+}
+
+/* No tree could be allocated. The game must go on under memory pressure
+ * rather than wait for a move that never comes.
+ */
+static int mcts_out_of_memory(const char *table)
+{
+    pr_warn_once("simrupt: MCTS out of memory, playing the first free grid\n");
+    return first_free_grid(table);
+}
+
+int mcts(char *table, char player)
+{
+    game_state_t board_state;
+    int n = READ_ONCE(mcts_workers), n_trees;
+    unsigned int budget_ms = READ_ONCE(mcts_budget_ms);
+    ktime_t deadline = budget_ms ? ktime_add_ms(ktime_get(), budget_ms) : 0;
+    int iterations = min_t(unsigned int, READ_ONCE(mcts_iterations), INT_MAX);
+
+    /* No cap only makes sense with a deadline */
+    if (!iterations)
+        iterations = deadline ? INT_MAX : ITERATIONS;
+
+    if (!n)
+        n = num_online_cpus();
+    n = clamp(n, 1, MCTS_MAX_WORKERS);
+    n_trees = n;
+
+    /* With separate trees, playouts and arena are split evenly between the
+     * workers. A shared tree is prepared here and then searched by all.
+     */
+    game_state_init(&board_state, table);
+    bool shared = READ_ONCE(mcts_shared_tree) && n > 1;
+    for (int i = 0; i < n; i++) {
+        workers[i].board_state = &board_state;
+        workers[i].player = player;
+        /* Rounded up without overflowing on INT_MAX, the deadline-only cap */
+        workers[i].iterations =
+            shared ? iterations : iterations / n + !!(iterations % n);
+        workers[i].deadline = deadline;
+        workers[i].capacity =
+            max_t(u32, READ_ONCE(mcts_nodes) / (shared ? 1 : n), 1);
+        workers[i].shared = NULL;
+        workers[i].ok = false;
+    }
+    /* Idle workers would otherwise hold their arenas until the unload */
+    for (int i = shared ? 1 : n; i < MCTS_MAX_WORKERS; i++)
+        tree_free(&workers[i].tree);
+    if (shared) {
+        struct mcts_tree *tree = &workers[0].tree;
+        workers[0].ok = tree_reuse(tree, &board_state, player,
+                                   workers[0].capacity);
+        if (!workers[0].ok)
+            return mcts_out_of_memory(table);
+        for (int i = 0; i < n; i++)
+            workers[i].shared = tree;
+        n_trees = 1;
+    }
+    /* The calling thread is worker 0 */
+    for (int i = 1; i < n; i++)
+        queue_work(mcts_wq, &workers[i].work);
+    worker_func(&workers[0].work);
+    for (int i = 1; i < n; i++)
+        flush_work(&workers[i].work);
+
+    /* Sum the visits of the root children. The trees may be kept in
+     * different orientations, so children are matched by the canonical key
+     * of the position they lead to, and their moves are mapped back onto the
+     * board through the canonical orientation of both positions.
+     */
+    u64 keys[N_GRIDS], key;
+    int moves[N_GRIDS], visits[N_GRIDS], n_moves = 0;
+    u8 proofs[N_GRIDS];
+    int board_sym = game_state_canonical(&board_state, &key);
+    bool searched = false;
+    for (int i = 0; i < n_trees; i++) {
+        struct mcts_tree *tree = &workers[i].tree;
+        if (!workers[i].ok)
+            continue;
+        searched = true;
+        int tree_sym = game_state_canonical(&tree->state, &key);
+        struct node *child = &tree->nodes[tree->nodes->children];
+        for (int c = 0; c < tree->nodes->n_children; c++, child++) {
+            int move =
+                sym_grids_inv[board_sym][sym_grids[tree_sym][child->move]];
+            int j;
+            make_move(&board_state, move, player);
+            game_state_canonical(&board_state, &key);
+            unmake_move(&board_state, move, player);
+            for (j = 0; j < n_moves && keys[j] != key; j++)
+                ;
+            if (j == n_moves) {
+                keys[n_moves] = key;
+                moves[n_moves] = move;
+                proofs[n_moves] = PROOF_NONE;
+                visits[n_moves++] = 0;
+            }
+            visits[j] += atomic_read(&child->n_visits);
+            proofs[j] = max(proofs[j], READ_ONCE(child->proof));
         }
     }
+
+    /* A proven win goes first and a proven loss last, whatever the visits */
     int best_move = -1;
-    if (best_node)
-        best_move = best_node->move;
-    free_node(root);
-    return best_move;
+    int best_rank = -1, most_visits = -1;
+    for (int j = 0; j < n_moves; j++) {
+        int rank = proofs[j] == PROOF_WIN ? 2 : proofs[j] != PROOF_LOSS;
+        if (rank > best_rank ||
+            (rank == best_rank && visits[j] > most_visits)) {
+            best_rank = rank;
+            most_visits = visits[j];
+            best_move = moves[j];
+        }
+    }
+    if (!searched)
+        return mcts_out_of_memory(table);
+    /* A root left unexpanded, as by a single playout, offers no move */
+    return best_move < 0 ? first_free_grid(table) : best_move;
 }
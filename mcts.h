@@ -1,5 +1,7 @@
 #pragma once
 
-#define ITERATIONS 100000
+#include <linux/workqueue.h>
 
+int mcts_init(struct workqueue_struct *wq);
+void mcts_exit(void);
 int mcts(char *table, char player);
@@ -82,7 +82,7 @@ u64 mt19937_rand(void)
 {
     int i;
     u64 x;
-    static const mag01[2] = {0ULL, MATRIX_A};
+    static const u64 mag01[2] = {0ULL, MATRIX_A};
 
     if (mti >= NN) { /* generate NN words at one time */
 
@@ -1,101 +1,258 @@
+#include <linux/cpumask.h>
 #include <linux/kernel.h> /* We are doing kernel work */
 #include <linux/module.h> /* Specifically, a module  */
 #include <linux/slab.h>
-#include <linux/sort.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "game.h"
 #include "negamax.h"
+#include "param.h"
 #include "util.h"
 #include "zobrist.h"
 
-#define MAX_SEARCH_DEPTH 6
+#define NEGAMAX_MAX_WORKERS 64
 
-static int history_score_sum[N_GRIDS];
-static int history_count[N_GRIDS];
+/* Lazy SMP: helpers run the same iterative deepening as the calling thread,
+ * on their own context but into its table, so that what one finds cuts the
+ * search of the others. To spread them out, every other helper starts one
+ * iteration deeper and each orders equal moves its own way. Only the result
+ * of the calling thread counts; the helpers are stopped once it is done.
+ */
+struct negamax_helper {
+    struct work_struct work;
+    struct search_ctx ctx;
+    const char *table;
+    char player;
+    int first_depth, last_depth;
+};
 
-static u64 hash_value;
+static struct negamax_helper helpers[NEGAMAX_MAX_WORKERS - 1];
+static struct workqueue_struct *negamax_wq;
 
-static int cmp_moves(const void *a, const void *b)
+/* Ordering keys above any average history score */
+#define ORDER_TT_MOVE INT_MAX
+#define ORDER_KILLER (INT_MAX - 1)
+
+static inline bool order_before(int key_a, int a, int key_b, int b, int skew)
 {
-    int *_a = (int *) a, *_b = (int *) b;
-    int score_a = 0, score_b = 0;
-
-    if (history_count[*_a])
-        score_a = history_score_sum[*_a] / history_count[*_a];
-    if (history_count[*_b])
-        score_b = history_score_sum[*_b] / history_count[*_b];
-    return score_b - score_a;
+    return key_a > key_b || (key_a == key_b && (a ^ skew) < (b ^ skew));
+}
+
+/* Sort @moves so that the move of the table entry comes first, then the
+ * killers of the ply, then the rest by their average history score. Each key
+ * is computed once, and an insertion sort is all that N_GRIDS moves need.
+ */
+static void order_moves(const struct search_ctx *ctx,
+                        int *moves,
+                        int n_moves,
+                        int tt_move)
+{
+    const s8 *killers = ctx->killers[ctx->state.n_empty];
+    int keys[N_GRIDS];
+
+    for (int i = 0; i < n_moves; i++) {
+        int move = moves[i], key = 0, j;
+
+        if (move == tt_move)
+            key = ORDER_TT_MOVE;
+        else if (move == killers[0])
+            key = ORDER_KILLER;
+        else if (move == killers[1])
+            key = ORDER_KILLER - 1;
+        else if (ctx->history_count[move])
+            key = ctx->history_score_sum[move] / ctx->history_count[move];
+        for (j = i; j > 0 && order_before(key, move, keys[j - 1],
+                                          moves[j - 1], ctx->skew);
+             j--) {
+            keys[j] = keys[j - 1];
+            moves[j] = moves[j - 1];
+        }
+        keys[j] = key;
+        moves[j] = move;
+    }
 }
 
-static move_t negamax(char *table, int depth, char player, int alpha, int beta)
+static void add_killer(struct search_ctx *ctx, int move)
 {
-    if (check_win(table) != ' ' || depth == 0) {
-        move_t result = {get_score(table, player), -1};
+    s8 *killers = ctx->killers[ctx->state.n_empty];
+
+    if (killers[0] == move)
+        return;
+    killers[1] = killers[0];
+    killers[0] = move;
+}
+
+static move_t negamax(struct search_ctx *ctx,
+                      int depth,
+                      char player,
+                      int alpha,
+                      int beta)
+{
+    game_state_t *state = &ctx->state;
+
+    if (state->winner != ' ' || depth == 0) {
+        move_t result = {game_state_score(state, player), -1};
         return result;
     }
-    zobrist_entry_t *entry = zobrist_get(hash_value);
-    if (entry)
-        return (move_t){.score = entry->score, .move = entry->move};
+    /* Positions equal up to symmetry share an entry, whose move is stored in
+     * the canonical frame. An entry searched at least as deep answers if its
+     * bound is enough for the window; any entry gives its move first.
+     */
+    u64 key;
+    int sym = game_state_canonical(state, &key);
+    int alpha_orig = alpha;
+    if (player == 'X')
+        key ^= zobrist_side;
+    zobrist_entry_t entry;
+    int tt_move = -1;
+    if (zobrist_get(ctx->tt, key, &entry)) {
+        tt_move = entry.move < 0 ? -1 : sym_grids_inv[sym][entry.move];
+        if (entry.depth >= depth &&
+            (entry.bound == ZOBRIST_EXACT ||
+             (entry.bound == ZOBRIST_LOWER && entry.score >= beta) ||
+             (entry.bound == ZOBRIST_UPPER && entry.score <= alpha)))
+            return (move_t){.score = entry.score, .move = tt_move};
+    }
 
     int score;
     move_t best_move = {-10000, -1};
-    int *moves = available_moves(table);
-    int n_moves = 0;
-    while (n_moves < N_GRIDS && moves[n_moves] != -1)
-        ++n_moves;
-    sort(moves, n_moves, sizeof(int), cmp_moves, NULL);
+    int moves[N_GRIDS];
+    int n_moves = available_moves(state, moves);
+    order_moves(ctx, moves, n_moves, tt_move);
     for (int i = 0; i < n_moves; i++) {
-        table[moves[i]] = player;
-        hash_value ^= zobrist_table[moves[i]][player == 'X'];
+        make_move(state, moves[i], player);
         if (!i)  // do a full search on the first move
-            score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X', -beta,
+            score = -negamax(ctx, depth - 1, player == 'X' ? 'O' : 'X', -beta,
                              -alpha)
                          .score;
         else {
             // do a null-window search on the rest of the moves
-            score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X',
+            score = -negamax(ctx, depth - 1, player == 'X' ? 'O' : 'X',
                              -alpha - 1, -alpha)
                          .score;
             if (alpha < score && score < beta)  // do a full re-search
-                score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X',
+                score = -negamax(ctx, depth - 1, player == 'X' ? 'O' : 'X',
                                  -beta, -score)
                              .score;
         }
-        history_count[moves[i]]++;
-        history_score_sum[moves[i]] += score;
+        ctx->history_count[moves[i]]++;
+        ctx->history_score_sum[moves[i]] += score;
         if (score > best_move.score) {
             best_move.score = score;
             best_move.move = moves[i];
         }
-        table[moves[i]] = ' ';
-        hash_value ^= zobrist_table[moves[i]][player == 'X'];
+        unmake_move(state, moves[i], player);
+        if (READ_ONCE(ctx->stop))
+            return best_move;
         if (score > alpha)
             alpha = score;
-        if (alpha >= beta)
+        if (alpha >= beta) {
+            add_killer(ctx, moves[i]);
             break;
+        }
     }
 
-    kfree((char *) moves);
-    zobrist_put(hash_value, best_move.score, best_move.move);
+    int bound = ZOBRIST_EXACT;
+    if (best_move.score <= alpha_orig)
+        bound = ZOBRIST_UPPER;
+    else if (best_move.score >= beta)
+        bound = ZOBRIST_LOWER;
+    zobrist_put(ctx->tt, key, best_move.score,
+                best_move.move < 0 ? -1 : sym_grids[sym][best_move.move], depth,
+                bound);
     return best_move;
 }
 
-void negamax_init()
+static void helper_func(struct work_struct *work);
+
+void negamax_init(struct workqueue_struct *wq)
 {
     zobrist_init();
-    hash_value = 0;
+    negamax_wq = wq;
+    for (int i = 0; i < ARRAY_SIZE(helpers); i++)
+        INIT_WORK(&helpers[i].work, helper_func);
+}
+
+void search_ctx_init(struct search_ctx *ctx, struct zobrist_tt *tt)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->tt = tt;
+}
+
+/* The iterations step by two plies, ending at negamax_depth */
+static int last_depth(void)
+{
+    return clamp_t(unsigned int, READ_ONCE(negamax_depth), 1, N_GRIDS);
+}
+
+/* The table keeps what the shallower iterations and the previous moves
+ * found; the deeper iterations start from it.
+ */
+static move_t iterate(struct search_ctx *ctx,
+                      const char *table,
+                      char player,
+                      int depth,
+                      int last)
+{
+    move_t result = {0, -1};
+
+    memset(ctx->history_score_sum, 0, sizeof(ctx->history_score_sum));
+    memset(ctx->history_count, 0, sizeof(ctx->history_count));
+    memset(ctx->killers, -1, sizeof(ctx->killers));
+    game_state_init(&ctx->state, table);
+    for (; depth <= last && !READ_ONCE(ctx->stop); depth += 2)
+        result = negamax(ctx, depth, player, -100000, 100000);
+    return result;
 }
 
-move_t negamax_predict(char *table, char player)
+move_t negamax_predict(struct search_ctx *ctx, char *table, char player)
 {
-    memset(history_score_sum, 0, sizeof(history_score_sum));
-    memset(history_count, 0, sizeof(history_count));
-    move_t result;
-    for (int depth = 2; depth <= MAX_SEARCH_DEPTH; depth += 2) {
-        result = negamax(table, depth, player, -100000, 100000);
-        zobrist_clear();
+    int last = last_depth();
+
+    zobrist_new_generation(ctx->tt);
+    return iterate(ctx, table, player, 2 - (last & 1), last);
+}
+
+static void helper_func(struct work_struct *work)
+{
+    struct negamax_helper *h =
+        container_of(work, struct negamax_helper, work);
+
+    iterate(&h->ctx, h->table, h->player, h->first_depth, h->last_depth);
+}
+
+/* negamax_predict() with negamax_workers - 1 helpers, or on its own with a
+ * single worker. The helpers are shared by every context, so only one such
+ * search may run at a time.
+ */
+move_t negamax_predict_smp(struct search_ctx *ctx, char *table, char player)
+{
+    int n = READ_ONCE(negamax_workers);
+    int last = last_depth(), first = 2 - (last & 1);
+
+    if (!n)
+        n = num_online_cpus();
+    n = clamp(n, 1, NEGAMAX_MAX_WORKERS);
+    if (n == 1)
+        return negamax_predict(ctx, table, player);
+
+    zobrist_new_generation(ctx->tt);
+    for (int i = 0; i < n - 1; i++) {
+        struct negamax_helper *h = &helpers[i];
+        search_ctx_init(&h->ctx, ctx->tt);
+        h->ctx.skew = i + 1;
+        h->table = table;
+        h->player = player;
+        h->first_depth = min(first + (i & 1 ? 0 : 2), last);
+        h->last_depth = last;
+        queue_work(negamax_wq, &h->work);
     }
+    move_t result = iterate(ctx, table, player, first, last);
+    for (int i = 0; i < n - 1; i++)
+        WRITE_ONCE(helpers[i].ctx.stop, true);
+    for (int i = 0; i < n - 1; i++)
+        flush_work(&helpers[i].work);
     return result;
 }
@@ -1,8 +1,36 @@
 #pragma once
 
+#include <linux/workqueue.h>
+
+#include "game.h"
+#include "zobrist.h"
+
 typedef struct {
     int score, move;
 } move_t;
 
-void negamax_init(void);
-move_t negamax_predict(char *table, char player);
+/* Everything a negamax search writes to: the position being searched, the
+ * history and killer heuristics and the transposition table. Searches with
+ * their own context can run at the same time, on one shared table or on
+ * several.
+ *
+ * killers[n] are the last two moves that failed high in positions with n
+ * empty grids, i.e. at one ply of the search, most recent first or -1.
+ *
+ * skew changes how moves of equal history are ordered, and setting stop makes
+ * the search unwind without storing anything more in the table.
+ */
+struct search_ctx {
+    game_state_t state;
+    struct zobrist_tt *tt;
+    int history_score_sum[N_GRIDS];
+    int history_count[N_GRIDS];
+    s8 killers[N_GRIDS + 1][2];
+    int skew;
+    bool stop;
+};
+
+void negamax_init(struct workqueue_struct *wq);
+void search_ctx_init(struct search_ctx *ctx, struct zobrist_tt *tt);
+move_t negamax_predict(struct search_ctx *ctx, char *table, char player);
+move_t negamax_predict_smp(struct search_ctx *ctx, char *table, char player);
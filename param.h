@@ -0,0 +1,44 @@
+#pragma once
+
+#include <linux/types.h>
+
+/* Tunables shared by every variant, exposed as module parameters by
+ * simrupt.c.
+ */
+
+/* Capacity of the MCTS node arena, in nodes */
+extern unsigned int mcts_nodes;
+
+/* Number of MCTS trees searched in parallel, 0 for one per online CPU */
+extern unsigned int mcts_workers;
+
+/* Let the MCTS workers search one shared tree instead of one tree each */
+extern bool mcts_shared_tree;
+
+/* Play immediate wins and block immediate losses in MCTS playouts */
+extern bool mcts_tactical;
+
+/* RAVE equivalence parameter of MCTS: after n playouts of a move its AMAF
+ * statistics weigh about mcts_rave / n. 0 for no RAVE.
+ */
+extern unsigned int mcts_rave;
+
+/* Playouts per MCTS move, 0 for no cap (only with mcts_budget_ms) */
+#define ITERATIONS 100000
+extern unsigned int mcts_iterations;
+
+/* Time budget of an MCTS move in milliseconds, 0 for none */
+extern unsigned int mcts_budget_ms;
+
+/* Size of the negamax transposition table of each variant, in MiB */
+extern unsigned int negamax_tt_mb;
+
+/* Threads of a negamax search (Lazy SMP), 0 for one per online CPU */
+extern unsigned int negamax_workers;
+
+/* Depth of the negamax search in plies */
+#define NEGAMAX_DEPTH 6
+extern unsigned int negamax_depth;
+
+/* Seed of the MCTS playout generators, 0 to seed them randomly */
+extern unsigned long long mcts_seed;
@@ -12,9 +12,8 @@
 #include <linux/workqueue.h>
 
 #include "chardev.h"
-#include "game.h"
-#include "mcts.h"
-#include "negamax.h"
+#include "param.h"
+#include "variant.h"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
@@ -44,11 +43,94 @@ static struct class *simrupt_class;
 static struct cdev simrupt_cdev;
 
 /* Game board*/
-static char table[N_GRIDS];
-#define BOARD_GRIDS 2 * 4 * (N_GRIDS + 1) + 2
+static char table[MAX_N_GRIDS];
+#define BOARD_GRIDS 2 * 4 * (MAX_N_GRIDS + 1) + 2
 static char board_buff[BOARD_GRIDS];
 char turn;
 
+/* Board variants compiled into the module, see variant.h */
+#define GAME_VARIANT_ENTRY(v) &v##_variant,
+static const struct game_variant *const game_variants[] = {
+    GAME_VARIANTS(GAME_VARIANT_ENTRY)};
+#undef GAME_VARIANT_ENTRY
+
+/* Variant of the game being played, and the one the next game will use */
+static const struct game_variant *game = &v4x4_variant;
+static const struct game_variant *next_game = &v4x4_variant;
+
+static int variant_set(const char *val, const struct kernel_param *kp)
+{
+    for (int i = 0; i < ARRAY_SIZE(game_variants); i++) {
+        if (sysfs_streq(val, game_variants[i]->name)) {
+            WRITE_ONCE(next_game, game_variants[i]);
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static int variant_get(char *buf, const struct kernel_param *kp)
+{
+    return sysfs_emit(buf, "%s\n", READ_ONCE(next_game)->name);
+}
+
+static const struct kernel_param_ops variant_ops = {
+    .set = variant_set,
+    .get = variant_get,
+};
+module_param_cb(variant, &variant_ops, NULL, 0644);
+MODULE_PARM_DESC(variant, "Board of the next game: 3x3, 4x4 or 5x5 (goal 4)");
+
+unsigned int mcts_nodes = 1 << 20;
+module_param(mcts_nodes, uint, 0644);
+MODULE_PARM_DESC(mcts_nodes, "Capacity of the MCTS node arena of each board");
+
+unsigned int mcts_workers;
+module_param(mcts_workers, uint, 0644);
+MODULE_PARM_DESC(mcts_workers,
+                 "MCTS trees searched in parallel, 0 for one per online CPU");
+
+bool mcts_shared_tree;
+module_param(mcts_shared_tree, bool, 0644);
+MODULE_PARM_DESC(mcts_shared_tree, "MCTS workers search a single shared tree");
+
+bool mcts_tactical = true;
+module_param(mcts_tactical, bool, 0644);
+MODULE_PARM_DESC(mcts_tactical,
+                 "MCTS playouts take immediate wins and block losses");
+
+unsigned int mcts_rave;
+module_param(mcts_rave, uint, 0644);
+MODULE_PARM_DESC(mcts_rave,
+                 "RAVE equivalence parameter of MCTS, 0 to disable RAVE");
+
+unsigned int mcts_iterations = ITERATIONS;
+module_param(mcts_iterations, uint, 0644);
+MODULE_PARM_DESC(mcts_iterations, "Playouts per MCTS move, 0 for no cap");
+
+unsigned int mcts_budget_ms;
+module_param(mcts_budget_ms, uint, 0644);
+MODULE_PARM_DESC(mcts_budget_ms,
+                 "Time budget of an MCTS move in ms, 0 for none");
+
+unsigned int negamax_tt_mb = 2;
+module_param(negamax_tt_mb, uint, 0444);
+MODULE_PARM_DESC(negamax_tt_mb,
+                 "Negamax transposition table size per variant, in MiB");
+
+unsigned int negamax_workers;
+module_param(negamax_workers, uint, 0644);
+MODULE_PARM_DESC(negamax_workers,
+                 "Negamax threads sharing one table, 0 for one per online CPU");
+
+unsigned int negamax_depth = NEGAMAX_DEPTH;
+module_param(negamax_depth, uint, 0644);
+MODULE_PARM_DESC(negamax_depth, "Depth of the negamax search in plies");
+
+unsigned long long mcts_seed;
+module_param(mcts_seed, ullong, 0444);
+MODULE_PARM_DESC(mcts_seed, "Seed of the MCTS playouts, 0 for a random one");
+
 /* Is the device open right now? Used to prevent concurrent access into
  * the same device
  */
@@ -97,25 +179,26 @@ static DEFINE_MUTEX(playerII_lock);
 static int draw_board(void)
 {
     int i = 0;
+    int board_size = game->board_size;
     board_buff[i++] = '\n';
     board_buff[i++] = '\n';
     smp_wmb();
-    for (int x = 0; x < BOARD_SIZE; x++) {
-        for (int y = 0; y < BOARD_SIZE; y++) {
+    for (int x = 0; x < board_size; x++) {
+        for (int y = 0; y < board_size; y++) {
             board_buff[i++] = ' ';
             smp_wmb();
-            WRITE_ONCE(board_buff[i++], table[GET_INDEX(x, y)]);
+            WRITE_ONCE(board_buff[i++], table[x * board_size + y]);
             smp_wmb();
             board_buff[i++] = ' ';
             smp_wmb();
-            if (y != BOARD_SIZE - 1) {
+            if (y != board_size - 1) {
                 board_buff[i++] = '|';
                 smp_wmb();
             }
         }
         board_buff[i++] = '\n';
         smp_wmb();
-        for (int y = 0; y < BOARD_SIZE; y++) {
+        for (int y = 0; y < board_size; y++) {
             board_buff[i++] = '-';
             board_buff[i++] = '-';
             board_buff[i++] = '-';
@@ -125,6 +208,9 @@ static int draw_board(void)
         board_buff[i++] = '\n';
         smp_wmb();
     }
+    /* Smaller boards do not fill the buffer sized for MAX_BOARD_SIZE */
+    memset(board_buff + i, 0, sizeof(board_buff) - i);
+    smp_wmb();
 
     return 0;
 }
@@ -216,10 +302,10 @@ static void Player_I_task(struct work_struct *w)
 
     int move;
     char ai = 'O';
-    while (check_win(table) == ' ') {
+    while (game->judge(table) == ' ') {
         mutex_lock(&playerI_lock);
         mutex_lock(&consumer_lock);
-        move = mcts(table, ai);
+        move = game->mcts_move(table, ai);
         if (move != -1) {
             WRITE_ONCE(table[move], ai);
         }
@@ -243,10 +329,10 @@ static void Player_II_task(struct work_struct *w)
 
     int move;
     char ai = 'X';
-    while (check_win(table) == ' ') {
+    while (game->judge(table) == ' ') {
         mutex_lock(&playerII_lock);
         mutex_lock(&consumer_lock);
-        move = negamax_predict(table, ai).move;
+        move = game->negamax_move(table, ai);
         if (move != -1) {
             WRITE_ONCE(table[move], ai);
         }
@@ -277,13 +363,14 @@ static void timer_handler(struct timer_list *__timer)
     local_irq_disable();
 
     tv_start = ktime_get();
-    char win = check_win(table);
+    char win = game->judge(table);
     process_data();
     if (win != ' ') {
         pr_info("simrupt: %c win!!!", win);
-        for (int i = 0; i < N_GRIDS; i++) {
+        for (int i = 0; i < MAX_N_GRIDS; i++) {
             table[i] = ' ';
         }
+        WRITE_ONCE(game, READ_ONCE(next_game));
         pr_info("------- enter first ------");
         queue_work(simrupt_workqueue, &player1);
         pr_info("------- enter second ------");
@@ -430,6 +517,7 @@ static const struct file_operations simrupt_fops = {
 
 static int __init simrupt_init(void)
 {
+    struct device *device;
     dev_t dev_id;
     int ret;
 
@@ -463,7 +551,8 @@ static int __init simrupt_init(void)
     }
 
     /* Register the device with sysfs */
-    device_create(simrupt_class, NULL, MKDEV(major, 0), NULL, DEV_NAME);
+    device =
+        device_create(simrupt_class, NULL, MKDEV(major, 0), NULL, DEV_NAME);
 
 
     /* Create the workqueue */
@@ -480,8 +569,20 @@ static int __init simrupt_init(void)
     atomic_set(&open_cnt, 0);
 
     /* init game table */
-    negamax_init();
-    for (int i = 0; i < N_GRIDS; i++) {
+    for (int i = 0; i < ARRAY_SIZE(game_variants); i++) {
+        ret = game_variants[i]->init(simrupt_workqueue,
+                                     IS_ERR(device) ? NULL : device);
+        if (ret) {
+            while (i--)
+                game_variants[i]->exit();
+            destroy_workqueue(simrupt_workqueue);
+            device_destroy(simrupt_class, dev_id);
+            class_destroy(simrupt_class);
+            goto error_cdev;
+        }
+    }
+    game = READ_ONCE(next_game);
+    for (int i = 0; i < MAX_N_GRIDS; i++) {
         table[i] = ' ';
     }
     message[0] = 0;
@@ -506,6 +607,8 @@ static void __exit simrupt_exit(void)
     tasklet_kill(&simrupt_tasklet);
     flush_workqueue(simrupt_workqueue);
     destroy_workqueue(simrupt_workqueue);
+    for (int i = 0; i < ARRAY_SIZE(game_variants); i++)
+        game_variants[i]->exit();
     device_destroy(simrupt_class, dev_id);
     class_destroy(simrupt_class);
     cdev_del(&simrupt_cdev);
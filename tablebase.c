@@ -0,0 +1,107 @@
+#include <linux/bitops.h>
+#include <linux/device.h>
+#include <linux/firmware.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#include "game.h"
+#include "tablebase.h"
+
+/* The tablebase of the variant, if one was found at load time. keys and
+ * entries point into the firmware image.
+ */
+static const struct firmware *tb_fw;
+static const __le32 *tb_keys;
+static const u8 *tb_entries;
+static unsigned int tb_bits;
+
+static bool tablebase_valid(const struct firmware *fw)
+{
+    const struct tablebase_header *hdr = (const void *) fw->data;
+    unsigned int bits;
+
+    if (fw->size < sizeof(*hdr) ||
+        memcmp(hdr->magic, TABLEBASE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != TABLEBASE_VERSION)
+        return false;
+    bits = le32_to_cpu(hdr->bits);
+    if (bits < 1 || bits > 30)
+        return false;
+    return fw->size == sizeof(*hdr) + (sizeof(__le32) + 1) * (1UL << bits);
+}
+
+/* Look for the tablebase of the variant. Having none is not an error: the
+ * agents then search every move.
+ */
+void tablebase_load(struct device *dev)
+{
+    const char *name = TABLEBASE_FW(VARIANT_NAME);
+    const struct tablebase_header *hdr;
+    const struct firmware *fw;
+
+    if (N_GRIDS > TABLEBASE_MAX_GRIDS)
+        return;
+    if (firmware_request_nowarn(&fw, name, dev))
+        return;
+    if (!tablebase_valid(fw)) {
+        pr_warn("simrupt: %s: invalid tablebase\n", name);
+        release_firmware(fw);
+        return;
+    }
+    /* The moves of a board solved under other rules would be wrong */
+    hdr = (const void *) fw->data;
+    if (hdr->board_size != BOARD_SIZE || hdr->goal != GOAL ||
+        hdr->allow_exceed != ALLOW_EXCEED) {
+        pr_warn("simrupt: %s: solved for %ux%u, %u in a row%s\n", name,
+                hdr->board_size, hdr->board_size, hdr->goal,
+                hdr->allow_exceed ? " or more" : "");
+        release_firmware(fw);
+        return;
+    }
+    tb_bits = le32_to_cpu(hdr->bits);
+    tb_keys = (const void *) (hdr + 1);
+    tb_entries = (const u8 *) (tb_keys + (1UL << tb_bits));
+    tb_fw = fw;
+    pr_info("simrupt: %s: %u positions\n", name,
+            le32_to_cpu(hdr->n_positions));
+}
+
+void tablebase_free(void)
+{
+    release_firmware(tb_fw);
+    tb_fw = NULL;
+}
+
+/* The best move of @player in @table, or -1 if the tablebase does not know
+ * the position. The position is looked up in its canonical form, whose move
+ * is mapped back onto @table through the symmetry that gave it.
+ */
+int tablebase_move(const char *table, char player)
+{
+    bitboard_t board[2], canon[2];
+    u32 key, mask;
+    int sym;
+
+    if (!tb_fw)
+        return -1;
+    bitboard_from_table(table, board);
+    if (!bitboard_is_turn(board, player))
+        return -1;
+    sym = bitboard_canonical(board, canon);
+    key = TABLEBASE_KEY(canon[0], canon[1]);
+
+    mask = (1U << tb_bits) - 1;
+    for (u32 i = 0, slot = tablebase_slot(key, tb_bits); i <= mask;
+         i++, slot = (slot + 1) & mask) {
+        u32 slot_key = le32_to_cpu(tb_keys[slot]);
+        if (slot_key == TABLEBASE_EMPTY)
+            break;
+        if (slot_key != key)
+            continue;
+        int move = TABLEBASE_MOVE(tb_entries[slot]);
+        if (move >= N_GRIDS || table[sym_grids_inv[sym][move]] != ' ')
+            break;
+        return sym_grids_inv[sym][move];
+    }
+    return -1;
+}
@@ -0,0 +1,74 @@
+/*
+ * tablebase.h - the file format of the endgame tablebases.
+ *
+ * The format is shared by the generator (tbgen.c), which solves a board in
+ * userspace, and the kernel module, which loads the result as firmware.
+ */
+
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <linux/types.h>
+
+/* Name of the tablebase of a variant under /lib/firmware */
+#define TABLEBASE_FW(variant_name) "tttkml-" variant_name ".tb"
+
+#define TABLEBASE_MAGIC "TTTB"
+#define TABLEBASE_VERSION 1
+
+/* A position is keyed by the bitboards of 'O' and 'X' side by side, so only
+ * boards of up to 16 grids fit.
+ */
+#define TABLEBASE_MAX_GRIDS 16
+#define TABLEBASE_KEY(o, x) ((__u32) (o) | (__u32) (x) << 16)
+
+/* No position has the same grid taken by both players */
+#define TABLEBASE_EMPTY 0xffffffffU
+
+/* Value of a position for the player to move */
+enum {
+    TABLEBASE_NONE,
+    TABLEBASE_LOSS,
+    TABLEBASE_DRAW,
+    TABLEBASE_WIN,
+};
+
+/* An entry packs the best move, in the frame of the key, and the value */
+#define TABLEBASE_MOVE(entry) ((entry) & 0x1f)
+#define TABLEBASE_VALUE(entry) ((entry) >> 5)
+#define TABLEBASE_ENTRY(move, value) ((__u8) ((move) | (value) << 5))
+
+/* The file is this header followed by __le32 keys[1 << bits] and then
+ * __u8 entries[1 << bits], an open-addressing hash table with linear probing.
+ * Only positions that are not over yet, reachable with 'O' moving first and
+ * canonical under the symmetries of the board are stored. The key of such a
+ * position is the smallest of its eight symmetric forms. The table is at
+ * most half full, so a probe stops at an empty slot after a step or two.
+ * board_size, goal and allow_exceed are the rules the board was solved
+ * under, which have to be those of the variant loading the file.
+ */
+struct tablebase_header {
+    char magic[4];
+    __u8 version;
+    __u8 board_size;
+    __u8 goal;
+    __u8 allow_exceed;
+    __le32 bits;
+    __le32 n_positions;
+};
+
+/* Fibonacci hashing of a key onto a table of 1 << @bits slots */
+static inline __u32 tablebase_slot(__u32 key, unsigned int bits)
+{
+    return (__u32) (key * 0x9e3779b1U) >> (32 - bits);
+}
+
+#ifdef __KERNEL__
+struct device;
+
+void tablebase_load(struct device *dev);
+void tablebase_free(void);
+int tablebase_move(const char *table, char player);
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+/*  tbgen.c - solve the 4x4 board with three in a row and write its tablebase
+ *
+ *  Every position reachable with 'O' moving first is solved exactly, up to
+ *  the symmetries of the board, and written in the format of tablebase.h.
+ *  Install the output under /lib/firmware before loading the module:
+ *
+ *      ./tbgen && sudo cp tttkml-4x4.tb /lib/firmware/
+ */
+
+#include "board.h"
+#include "tablebase.h"
+
+#include <endian.h>
+#include <stdint.h>
+#include <stdio.h>  /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <string.h>
+
+/* The rules of variant_4x4.c, which tablebase_load() checks against those of
+ * the variant loading the file: a run of GOAL or more stones wins.
+ */
+#define BOARD_SIZE 4
+#define GOAL 3
+#define ALLOW_EXCEED 1
+#define N_GRIDS (BOARD_SIZE * BOARD_SIZE)
+
+#if N_GRIDS > TABLEBASE_MAX_GRIDS
+#error "the board does not fit a tablebase key"
+#endif
+
+static uint32_t canonical(uint32_t o, uint32_t x)
+{
+    uint32_t board[2] = {o, x}, canon[2];
+
+    board_canonical(board, canon);
+    return TABLEBASE_KEY(canon[0], canon[1]);
+}
+
+/* Solved positions, keyed like the tablebase. dist is the number of plies
+ * to the end of the game under best play, which picks the fastest win and
+ * the slowest loss.
+ */
+struct solved {
+    uint32_t key;
+    uint8_t value, move, dist;
+};
+
+#define MEMO_BITS 21
+static struct solved *memo;
+static uint32_t n_solved;
+
+static struct solved *memo_slot(uint32_t key)
+{
+    uint32_t mask = (1U << MEMO_BITS) - 1;
+    uint32_t slot = tablebase_slot(key, MEMO_BITS);
+
+    while (memo[slot].key != TABLEBASE_EMPTY && memo[slot].key != key)
+        slot = (slot + 1) & mask;
+    return &memo[slot];
+}
+
+/* Is (value, dist) better for the player to move than (best, best_dist)? */
+static int better(int value, int dist, int best, int best_dist)
+{
+    if (value != best)
+        return value > best;
+    if (value == TABLEBASE_WIN)
+        return dist < best_dist;
+    return dist > best_dist;
+}
+
+/* Solve the canonical position @o, @x, which is not over yet */
+static const struct solved *solve(uint32_t o, uint32_t x)
+{
+    struct solved *s = memo_slot(TABLEBASE_KEY(o, x));
+    if (s->key != TABLEBASE_EMPTY)
+        return s;
+
+    int x_moves = __builtin_popcount(o) != __builtin_popcount(x);
+    int best = TABLEBASE_NONE, best_dist = 0, best_move = -1;
+    for (int m = 0; m < N_GRIDS; m++) {
+        uint32_t bit = 1U << m;
+        if ((o | x) & bit)
+            continue;
+        uint32_t no = x_moves ? o : o | bit, nx = x_moves ? x | bit : x;
+        int value, dist = 1;
+        if (board_wins(x_moves ? nx : no, m)) {
+            value = TABLEBASE_WIN;
+        } else if ((no | nx) == full_board) {
+            value = TABLEBASE_DRAW;
+        } else {
+            uint32_t key = canonical(no, nx);
+            const struct solved *child = solve(key & 0xffff, key >> 16);
+            value = TABLEBASE_LOSS + TABLEBASE_WIN - child->value;
+            dist += child->dist;
+        }
+        if (best_move < 0 || better(value, dist, best, best_dist)) {
+            best = value;
+            best_dist = dist;
+            best_move = m;
+        }
+    }
+
+    /* The children solved meanwhile may have taken the slot found above */
+    s = memo_slot(TABLEBASE_KEY(o, x));
+    s->key = TABLEBASE_KEY(o, x);
+    s->value = best;
+    s->move = best_move;
+    s->dist = best_dist;
+    n_solved++;
+    return s;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : TABLEBASE_FW("4x4");
+    unsigned int bits = 1;
+
+    memo = malloc(sizeof(*memo) << MEMO_BITS);
+    if (!memo) {
+        perror("malloc");
+        exit(1);
+    }
+    memset(memo, 0xff, sizeof(*memo) << MEMO_BITS);
+    board_init(BOARD_SIZE, GOAL, ALLOW_EXCEED);
+    solve(0, 0);
+
+    /* Keep the table at most half full */
+    while ((1U << bits) < 2 * n_solved)
+        bits++;
+    uint32_t n_slots = 1U << bits, mask = n_slots - 1;
+    uint32_t *keys = malloc(n_slots * sizeof(*keys));
+    uint8_t *entries = calloc(n_slots, 1);
+    if (!keys || !entries) {
+        perror("malloc");
+        exit(1);
+    }
+    memset(keys, 0xff, n_slots * sizeof(*keys));
+    for (uint32_t i = 0; i < 1U << MEMO_BITS; i++) {
+        const struct solved *s = &memo[i];
+        if (s->key == TABLEBASE_EMPTY)
+            continue;
+        uint32_t slot = tablebase_slot(s->key, bits);
+        while (keys[slot] != TABLEBASE_EMPTY)
+            slot = (slot + 1) & mask;
+        keys[slot] = htole32(s->key);
+        entries[slot] = TABLEBASE_ENTRY(s->move, s->value);
+    }
+
+    struct tablebase_header hdr = {
+        .magic = TABLEBASE_MAGIC,
+        .version = TABLEBASE_VERSION,
+        .board_size = BOARD_SIZE,
+        .goal = GOAL,
+        .allow_exceed = ALLOW_EXCEED,
+        .bits = htole32(bits),
+        .n_positions = htole32(n_solved),
+    };
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(keys, sizeof(*keys), n_slots, f) != n_slots ||
+        fwrite(entries, 1, n_slots, f) != n_slots || fclose(f)) {
+        perror(path);
+        exit(1);
+    }
+    printf("%s: %u positions, %u slots\n", path, n_solved, n_slots);
+    return 0;
+}
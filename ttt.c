@@ -47,7 +47,7 @@ int ioctl_set_msg(int file_desc, char *message)
 int ioctl_get_msg(int file_desc)
 {
     int ret_val;
-    char message[150] = {0};
+    char message[256] = {0};
 
     /* Warning - this is dangerous because we don't tell
      * the kernel how far it's allowed to write, so it
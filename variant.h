@@ -0,0 +1,82 @@
+#pragma once
+
+#include <linux/workqueue.h>
+
+struct device;
+
+/* The game engines (game.c, zobrist.c, negamax.c, mcts.c, tablebase.c and
+ * book.c) are written against the compile-time constants BOARD_SIZE, GOAL and
+ * ALLOW_EXCEED. Each variant_*.c fixes those constants and includes engine.c,
+ * so every variant gets its own copy of the engines with constant loop
+ * bounds and tables sized for its board. simrupt.c then picks one per game
+ * through struct game_variant.
+ */
+
+/* Largest board among the variants, used to size the buffers in simrupt.c */
+#define MAX_BOARD_SIZE 5
+#define MAX_N_GRIDS (MAX_BOARD_SIZE * MAX_BOARD_SIZE)
+
+struct game_variant {
+    const char *name;
+    int board_size;
+    int goal;
+    int (*init)(struct workqueue_struct *wq, struct device *dev);
+    void (*exit)(void);
+    char (*judge)(char *table);
+    int (*mcts_move)(char *table, char player);
+    int (*negamax_move)(char *table, char player);
+};
+
+#define GAME_VARIANTS(_) \
+    _(v3x3)              \
+    _(v4x4)              \
+    _(v5x5)
+
+#define DECLARE_GAME_VARIANT(v) extern const struct game_variant v##_variant;
+GAME_VARIANTS(DECLARE_GAME_VARIANT)
+#undef DECLARE_GAME_VARIANT
+
+#ifdef VARIANT
+/* Give the external symbols of the engines a per-variant prefix so that the
+ * copies in different variant_*.c do not clash at link time.
+ */
+#define __VARIANT_SYM(v, name) v##_##name
+#define _VARIANT_SYM(v, name) __VARIANT_SYM(v, name)
+#define VARIANT_SYM(name) _VARIANT_SYM(VARIANT, name)
+
+#define lines VARIANT_SYM(lines)
+#define win_masks VARIANT_SYM(win_masks)
+#define win_borders VARIANT_SYM(win_borders)
+#define grid_segs VARIANT_SYM(grid_segs)
+#define n_grid_segs VARIANT_SYM(n_grid_segs)
+#define pattern_score VARIANT_SYM(pattern_score)
+#define sym_grids VARIANT_SYM(sym_grids)
+#define sym_grids_inv VARIANT_SYM(sym_grids_inv)
+#define game_init VARIANT_SYM(game_init)
+#define available_moves VARIANT_SYM(available_moves)
+#define check_win VARIANT_SYM(check_win)
+#define calculate_win_value VARIANT_SYM(calculate_win_value)
+#define bitboard_from_table VARIANT_SYM(bitboard_from_table)
+#define game_state_init VARIANT_SYM(game_state_init)
+#define make_move VARIANT_SYM(make_move)
+#define unmake_move VARIANT_SYM(unmake_move)
+#define zobrist_table VARIANT_SYM(zobrist_table)
+#define zobrist_init VARIANT_SYM(zobrist_init)
+#define zobrist_tt_init VARIANT_SYM(zobrist_tt_init)
+#define zobrist_tt_free VARIANT_SYM(zobrist_tt_free)
+#define zobrist_get VARIANT_SYM(zobrist_get)
+#define zobrist_put VARIANT_SYM(zobrist_put)
+#define zobrist_new_generation VARIANT_SYM(zobrist_new_generation)
+#define zobrist_side VARIANT_SYM(zobrist_side)
+#define negamax_init VARIANT_SYM(negamax_init)
+#define search_ctx_init VARIANT_SYM(search_ctx_init)
+#define negamax_predict VARIANT_SYM(negamax_predict)
+#define negamax_predict_smp VARIANT_SYM(negamax_predict_smp)
+#define tablebase_load VARIANT_SYM(tablebase_load)
+#define tablebase_free VARIANT_SYM(tablebase_free)
+#define tablebase_move VARIANT_SYM(tablebase_move)
+#define book_move VARIANT_SYM(book_move)
+#define mcts VARIANT_SYM(mcts)
+#define mcts_init VARIANT_SYM(mcts_init)
+#define mcts_exit VARIANT_SYM(mcts_exit)
+#endif
@@ -0,0 +1,10 @@
+/* 3x3 board, three in a row */
+
+#define VARIANT v3x3
+#define VARIANT_NAME "3x3"
+#define BOARD_SIZE 3
+#define GOAL 3
+#define ALLOW_EXCEED 1
+#define BOOK_FILE "book_3x3.h"
+
+#include "engine.c"
@@ -0,0 +1,10 @@
+/* 4x4 board, three in a row */
+
+#define VARIANT v4x4
+#define VARIANT_NAME "4x4"
+#define BOARD_SIZE 4
+#define GOAL 3
+#define ALLOW_EXCEED 1
+#define BOOK_FILE "book_4x4.h"
+
+#include "engine.c"
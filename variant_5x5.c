@@ -0,0 +1,10 @@
+/* 5x5 board, four in a row */
+
+#define VARIANT v5x5
+#define VARIANT_NAME "5x5"
+#define BOARD_SIZE 5
+#define GOAL 4
+#define ALLOW_EXCEED 1
+#define BOOK_FILE "book_5x5.h"
+
+#include "engine.c"
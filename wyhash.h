@@ -1,5 +1,6 @@
-#include <linux/string.h>
-#include <linux/timer.h>
+#pragma once
+
+#include <linux/types.h>
 
 static inline u64 wyhash64_stateless(u64 *seed)
 {
@@ -12,8 +13,17 @@ static inline u64 wyhash64_stateless(u64 *seed)
     return m2;
 }
 
-u64 wyhash64(void)
+/* Fill @idx[k], for k < @n, with a uniform index below @bound - k: the
+ * choices of a playout that picks among the remaining moves at every ply.
+ * Each 64-bit draw gives two 32-bit fractions, scaled to the bound with a
+ * multiply and shift instead of a division.
+ */
+static inline void wyhash64_fill_bounded(u64 *seed, u8 *idx, int n, u32 bound)
 {
-    u64 seed = (u64) ktime_to_ns(ktime_get());
-    return wyhash64_stateless(&seed);
-}
\ No newline at end of file
+    for (int k = 0; k < n; k += 2) {
+        u64 r = wyhash64_stateless(seed);
+        idx[k] = ((r & 0xffffffff) * (bound - k)) >> 32;
+        if (k + 1 < n)
+            idx[k + 1] = ((r >> 32) * (bound - k - 1)) >> 32;
+    }
+}
@@ -1,14 +1,24 @@
 #include <linux/kernel.h> /* We are doing kernel work */
+#include <linux/log2.h>
 #include <linux/module.h> /* Specifically, a module  */
+#include <linux/vmalloc.h>
 
 #include "mt19937-64.h"
 #include "zobrist.h"
 
 u64 zobrist_table[N_GRIDS][2];
+u64 zobrist_side;
 
-#define HASH(key) ((key) % HASH_TABLE_SIZE)
-
-static struct hlist_head *hash_table;
+/* A table is allocated once, with a power of two number of buckets so that
+ * the low bits of the key pick the bucket. An entry lives anywhere in its
+ * bucket.
+ *
+ * Entries stay valid for as long as the table lives, as the key covers the
+ * whole position. The generation only ages them: each search starts a new
+ * one, and an entry loses ZOBRIST_AGE_PLIES of depth per generation when
+ * picking what to replace, as the root of the next move is that much deeper.
+ */
+#define ZOBRIST_AGE_PLIES 2
 
 void zobrist_init(void)
 {
@@ -17,47 +27,106 @@ void zobrist_init(void)
         zobrist_table[i][0] = mt19937_rand();
         zobrist_table[i][1] = mt19937_rand();
     }
-    hash_table = vmalloc(sizeof(struct hlist_head) * HASH_TABLE_SIZE);
-    BUG_ON(!hash_table);
-    for (i = 0; i < HASH_TABLE_SIZE; i++)
-        INIT_HLIST_HEAD(&hash_table[i]);
+    zobrist_side = mt19937_rand();
+}
+
+/* Settle for a smaller table if the requested size is not available */
+int zobrist_tt_init(struct zobrist_tt *tt, unsigned int size_mb)
+{
+    size_t n_buckets =
+        ((size_t) max(size_mb, 1U) << 20) / sizeof(zobrist_bucket_t);
+
+    for (n_buckets = rounddown_pow_of_two(n_buckets); n_buckets;
+         n_buckets >>= 1) {
+        tt->buckets =
+            vzalloc(array_size(n_buckets, sizeof(zobrist_bucket_t)));
+        if (tt->buckets)
+            break;
+    }
+    if (!tt->buckets)
+        return -ENOMEM;
+    tt->mask = n_buckets - 1;
+    tt->generation = 0;
+    return 0;
 }
 
-zobrist_entry_t *zobrist_get(u64 key)
+void zobrist_tt_free(struct zobrist_tt *tt)
 {
-    unsigned long long hash_key = HASH(key);
+    vfree(tt->buckets);
+    tt->buckets = NULL;
+}
 
-    if (hlist_empty(&hash_table[hash_key]))
-        return NULL;
+/* Snapshot an entry that other searches may be rewriting meanwhile */
+static void entry_read(const zobrist_entry_t *slot, zobrist_entry_t *entry)
+{
+    entry->data = READ_ONCE(slot->data);
+    entry->check = READ_ONCE(slot->check);
+}
 
-    zobrist_entry_t *entry = NULL;
-    hlist_for_each_entry (entry, &hash_table[hash_key], ht_list) {
-        if (entry->key == key)
-            return entry;
+static bool entry_match(const zobrist_entry_t *entry, u64 key)
+{
+    return entry->bound != ZOBRIST_NONE && (entry->check ^ entry->data) == key;
+}
+
+/* Copy the entry of @key into @entry, if the table has one */
+bool zobrist_get(struct zobrist_tt *tt, u64 key, zobrist_entry_t *entry)
+{
+    zobrist_bucket_t *bucket = &tt->buckets[key & tt->mask];
+
+    for (int i = 0; i < ZOBRIST_BUCKET_SIZE; i++) {
+        entry_read(&bucket->entries[i], entry);
+        if (entry_match(entry, key))
+            return true;
     }
-    return NULL;
+    return false;
 }
 
-void zobrist_put(u64 key, int score, int move)
+static int entry_worth(const struct zobrist_tt *tt,
+                       const zobrist_entry_t *entry)
 {
-    unsigned long long hash_key = HASH(key);
-    zobrist_entry_t *new_entry = vmalloc(sizeof(zobrist_entry_t));
-    BUG_ON(!new_entry);
-    new_entry->key = key;
-    new_entry->move = move;
-    new_entry->score = score;
-    hlist_add_head(&new_entry->ht_list, &hash_table[hash_key]);
+    if (entry->bound == ZOBRIST_NONE)
+        return INT_MIN;
+    u8 age = tt->generation - entry->gen;
+    return entry->depth - ZOBRIST_AGE_PLIES * age;
 }
 
-void zobrist_clear(void)
+/* An entry for the same position is updated in place. Otherwise the new
+ * entry always goes in, over the least worth one of the bucket, so that deep
+ * and recent results survive as long as there is room for them.
+ */
+void zobrist_put(struct zobrist_tt *tt,
+                 u64 key,
+                 int score,
+                 int move,
+                 int depth,
+                 int bound)
 {
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        while (!hlist_empty(&hash_table[i])) {
-            zobrist_entry_t *entry;
-            entry = hlist_entry(hash_table[i].first, zobrist_entry_t, ht_list);
-            hlist_del(&entry->ht_list);
-            vfree(entry);
+    zobrist_bucket_t *bucket = &tt->buckets[key & tt->mask];
+    zobrist_entry_t *victim = NULL, entry;
+    int victim_worth = INT_MAX;
+
+    for (int i = 0; i < ZOBRIST_BUCKET_SIZE; i++) {
+        entry_read(&bucket->entries[i], &entry);
+        if (entry_match(&entry, key)) {
+            victim = &bucket->entries[i];
+            break;
+        }
+        int worth = entry_worth(tt, &entry);
+        if (worth < victim_worth) {
+            victim = &bucket->entries[i];
+            victim_worth = worth;
         }
-        INIT_HLIST_HEAD(&hash_table[i]);
     }
+    entry.score = score;
+    entry.move = move;
+    entry.depth = depth;
+    entry.bound = bound;
+    entry.gen = tt->generation;
+    WRITE_ONCE(victim->check, key ^ entry.data);
+    WRITE_ONCE(victim->data, entry.data);
+}
+
+void zobrist_new_generation(struct zobrist_tt *tt)
+{
+    tt->generation++;
 }
@@ -1,22 +1,65 @@
 #pragma once
 
-#include <linux/list.h>
+#include <linux/cache.h>
 #include <linux/types.h>
-#include <linux/vmalloc.h>
 #include "game.h"
 
-#define HASH_TABLE_SIZE ((int) 1e6 + 3)  // choose a large prime number
-
 extern u64 zobrist_table[N_GRIDS][2];
+extern u64 zobrist_side;
+
+/* How the stored score relates to the true value of the position */
+enum {
+    ZOBRIST_NONE, /* empty slot */
+    ZOBRIST_EXACT,
+    ZOBRIST_LOWER, /* the search failed high */
+    ZOBRIST_UPPER, /* the search failed low */
+};
 
+/* Packed into 16 bytes so that a bucket of ZOBRIST_BUCKET_SIZE entries fills
+ * one cache line. depth is the depth searched below the position and gen the
+ * generation of the search that stored it.
+ *
+ * Searches sharing a table write entries without a lock: check holds the key
+ * XORed with data, so an entry torn by two writers no longer matches either
+ * key and reads as a miss.
+ */
 typedef struct {
-    u64 key;
-    int score;
-    int move;
-    struct hlist_node ht_list;
+    u64 check;
+    union {
+        struct {
+            s32 score;
+            s8 move;
+            u8 depth;
+            u8 bound;
+            u8 gen;
+        };
+        u64 data;
+    };
 } zobrist_entry_t;
 
+#define ZOBRIST_BUCKET_SIZE (SMP_CACHE_BYTES / sizeof(zobrist_entry_t))
+
+typedef struct {
+    zobrist_entry_t entries[ZOBRIST_BUCKET_SIZE];
+} zobrist_bucket_t;
+
+/* A transposition table. Each search context refers to one, and contexts
+ * may share one while they search.
+ */
+struct zobrist_tt {
+    zobrist_bucket_t *buckets;
+    size_t mask;
+    u8 generation;
+};
+
 void zobrist_init(void);
-zobrist_entry_t *zobrist_get(u64 key);
-void zobrist_put(u64 key, int score, int move);
-void zobrist_clear(void);
+int zobrist_tt_init(struct zobrist_tt *tt, unsigned int size_mb);
+void zobrist_tt_free(struct zobrist_tt *tt);
+bool zobrist_get(struct zobrist_tt *tt, u64 key, zobrist_entry_t *entry);
+void zobrist_put(struct zobrist_tt *tt,
+                 u64 key,
+                 int score,
+                 int move,
+                 int depth,
+                 int bound);
+void zobrist_new_generation(struct zobrist_tt *tt);